@@ -0,0 +1,382 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Replays labelled pulse traces through the real firmware and reports
+// how well it followed the tool:
+//
+//   on latency    tool switched on -> vacuum relay on
+//   off latency   tool switched off -> vacuum relay off
+//   missed        tool runs the vacuum never came on for
+//   false starts  relay switched on with no tool running
+//   cycles/h      relay switch-ons per simulated hour
+//   loops/s       loop() passes per simulated second
+//   shows/s       LED frames sent per simulated second
+//   asleep        share of simulated time the CPU spent asleep
+//   latency       longest wait between a pulse's capture and update()
+//   speed         simulated seconds per wall-clock second
+//
+// The firmware runs in no virtual time of its own, so each pass is
+// charged -c microseconds (200 by default) after it returns; pulses that
+// land in that time wait for the next pass, as they would on the board.
+// The asleep and latency columns only mean as much as that figure:
+// measure it with a LOOP_TIMING build (the 't' command's whole-pass
+// stage) and pass it in.
+//
+// While the relay is on, the vacuum's own draw (-V, 1500W by default) is
+// added to the meter as extra pulses, fitted in between the trace's.
+//
+// The firmware is a set of globals, so each trace runs in its own
+// forked process, several at a time.
+//
+//   autovac_bench [-p profile,...] [-n seeds] [-H hours] [-s step_us]
+//                 [-c us_per_pass] [-e average|interval|change]
+//                 [-k drift] [-d threshold] [-V watts] [-j jobs]
+//                 [trace files...]
+//   autovac_bench -g profile [-S seed] [-H hours] [-o file]
+
+#include <ArduinoHost.h>
+#include <PulseTrace.h>
+#include "Channel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+void setup();
+void loop();
+extern Channel channels[];
+
+namespace
+{
+  // Wiring, from the board profile AutoVac.cpp takes it from.
+  const uint8_t PULSE_PIN = Board::PULSE_PIN;
+  const uint8_t RELAY_PIN = Board::RELAY_PIN;
+  const uint8_t ARMED_PIN = Board::ARMED_PIN;
+
+  const uint64_t SECOND = 1000000;
+  const uint64_t PULSE_WIDTH = 30000;      // S0 pulse length before the counted rising edge.
+  const uint64_t TAIL = 30 * SECOND;       // Run on after the trace so the last stop registers.
+  const uint64_t LATE_GRACE = 10 * SECOND; // A start this soon after a run is late, not false.
+  const uint64_t PULSE_GAP = 5000;         // Vacuum pulses keep this far clear of trace pulses.
+  const double WH_PER_PULSE = 0.5;
+
+  struct Latency
+  {
+    unsigned count;
+    double mean;
+    double median;
+    double p95;
+    double max;
+  };
+
+  struct Result
+  {
+    char name[64];
+    double simSeconds;
+    double wallSeconds;
+    unsigned toolRuns;
+    unsigned missed;
+    unsigned falseStarts;
+    unsigned relayOns;
+    double loopsPerSecond;
+    double showsPerSecond;
+    double asleep;
+    double pulseLatency;
+    Latency on;
+    Latency off;
+  };
+
+  struct Options
+  {
+    uint64_t step;
+    uint64_t cost;
+    int estimator;
+    long drift;
+    long threshold;
+    double vacuum;
+  };
+
+  struct RelayLog
+  {
+    bool on;
+    std::vector<std::pair<uint64_t, bool> > changes;
+  };
+
+  void relayWritten(uint8_t pin, uint8_t level, void *context)
+  {
+    RelayLog *log = (RelayLog *)context;
+    bool on = pin == RELAY_PIN && level == LOW; // The relay is active low.
+    if (pin != RELAY_PIN || on == log->on) return;
+    log->on = on;
+    log->changes.push_back(std::make_pair(HostClock::now(), on));
+  }
+
+  Latency summarise(std::vector<double> samples)
+  {
+    Latency l;
+    memset(&l, 0, sizeof(l));
+    l.count = samples.size();
+    if (samples.empty()) return l;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); i++) sum += samples[i];
+    l.mean = sum / samples.size();
+    l.median = samples[samples.size() / 2];
+    l.p95 = samples[(samples.size() * 95) / 100 < samples.size() ? (samples.size() * 95) / 100 : samples.size() - 1];
+    l.max = samples.back();
+    return l;
+  }
+
+  // Schedules each counted rising edge, preceded by the falling edge of
+  // the pulse.
+  void schedulePulses(const Trace &trace)
+  {
+    std::vector<std::pair<uint64_t, uint64_t> > edges = pulseEdges(trace, PULSE_WIDTH);
+    for (size_t i = 0; i < edges.size(); i++) {
+      HostPins::schedule(edges[i].first, PULSE_PIN, LOW);
+      HostPins::schedule(edges[i].second, PULSE_PIN, HIGH);
+    }
+  }
+
+  // Puts a vacuum pulse at or after `at` where it can't merge with a
+  // trace pulse. `pulses` holds the trace's pulse times, in order.
+  void scheduleVacuumPulse(const std::vector<uint64_t> &pulses, uint64_t at)
+  {
+    at = clearOfPulses(pulses, at, PULSE_WIDTH, PULSE_GAP);
+    HostPins::schedule(at, PULSE_PIN, LOW);
+    HostPins::schedule(at + PULSE_WIDTH, PULSE_PIN, HIGH);
+  }
+
+  void score(const Trace &trace, const RelayLog &relay, Result &result)
+  {
+    RelayScore score = scoreRelay(trace, relay.changes, LATE_GRACE);
+    result.toolRuns = score.toolRuns;
+    result.missed = score.missed;
+    result.falseStarts = score.falseStarts;
+    result.relayOns = score.relayOns;
+    result.on = summarise(score.onLatency);
+    result.off = summarise(score.offLatency);
+  }
+
+  Result replay(const Trace &trace, const Options &options)
+  {
+    Result result;
+    memset(&result, 0, sizeof(result));
+    snprintf(result.name, sizeof(result.name), "%s", trace.name.c_str());
+
+    hostReset();
+    HostSerial::setSink(NULL, NULL);
+    RelayLog relay;
+    relay.on = false;
+    HostPins::onWrite(relayWritten, &relay);
+    HostPins::set(ARMED_PIN, LOW);
+    HostPins::set(PULSE_PIN, HIGH);
+
+    setup();
+    if (options.estimator >= 0) channels[0].meter().estimator((PowerMeter::Estimator)options.estimator);
+    channels[0].meter().detector().tune(options.drift, options.threshold);
+    schedulePulses(trace);
+    std::vector<uint64_t> pulses = pulseTimes(trace);
+    double vacuumWh = 0;
+
+    uint64_t end = trace.duration() + TAIL;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    uint64_t loops = 0;
+    while (HostClock::now() < end) {
+      uint64_t before = HostClock::now();
+      loop();
+      loops++;
+      HostClock::advance(options.cost);
+      if (HostClock::now() == before) {
+        HostClock::advance(options.step);
+      }
+      if (relay.on) {
+        vacuumWh += options.vacuum * (HostClock::now() - before) / 3600e6;
+        if (vacuumWh >= WH_PER_PULSE) {
+          vacuumWh -= WH_PER_PULSE;
+          scheduleVacuumPulse(pulses, HostClock::now() + 1000);
+        }
+      }
+    }
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    result.simSeconds = end / 1e6;
+    result.loopsPerSecond = loops / result.simSeconds;
+    result.showsPerSecond = HostNeoPixel::shows() / result.simSeconds;
+    result.asleep = (double)HostSleep::slept() / HostClock::now();
+    result.pulseLatency = channels[0].meter().maxPulseLatency() / 1e3;
+
+    score(trace, relay, result);
+    return result;
+  }
+
+  // Runs every trace in a child process, `jobs` at a time, and collects
+  // the results through pipes.
+  std::vector<Result> replayAll(const std::vector<Trace> &traces, const Options &options, int jobs)
+  {
+    std::vector<Result> results(traces.size());
+    std::vector<std::pair<pid_t, std::pair<int, size_t> > > running;
+    size_t next = 0;
+
+    while (next < traces.size() || !running.empty()) {
+      while (next < traces.size() && (int)running.size() < jobs) {
+        int fds[2];
+        if (pipe(fds) != 0) { perror("pipe"); exit(1); }
+        pid_t pid = fork();
+        if (pid == 0) {
+          close(fds[0]);
+          Result r = replay(traces[next], options);
+          ssize_t written = write(fds[1], &r, sizeof(r));
+          _exit(written == (ssize_t)sizeof(r) ? 0 : 1);
+        }
+        close(fds[1]);
+        running.push_back(std::make_pair(pid, std::make_pair(fds[0], next)));
+        next++;
+      }
+
+      std::pair<pid_t, std::pair<int, size_t> > job = running.front();
+      running.erase(running.begin());
+      Result &r = results[job.second.second];
+      if (read(job.second.first, &r, sizeof(r)) != (ssize_t)sizeof(r)) {
+        memset(&r, 0, sizeof(r));
+        snprintf(r.name, sizeof(r.name), "%s (failed)", traces[job.second.second].name.c_str());
+      }
+      close(job.second.first);
+      waitpid(job.first, NULL, 0);
+    }
+    return results;
+  }
+
+  void report(const std::vector<Result> &results)
+  {
+    printf("%-22s %5s %6s %6s %8s %8s %8s %8s %8s %8s %8s %8s %7s %8s %9s\n",
+           "trace", "runs", "missed", "false", "cycles/h",
+           "on.med", "on.p95", "on.max", "off.med", "off.max",
+           "loops/s", "shows/s", "asleep", "latency", "speed");
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      double hours = r.simSeconds / 3600;
+      printf("%-22s %5u %6u %6u %8.1f %7.2fs %7.2fs %7.2fs %7.2fs %7.2fs %8.1f %8.2f %6.1f%% %6.1fms %8.0fx\n",
+             r.name, r.toolRuns, r.missed, r.falseStarts, hours > 0 ? r.relayOns / hours : 0,
+             r.on.median, r.on.p95, r.on.max, r.off.median, r.off.max,
+             r.loopsPerSecond, r.showsPerSecond, 100 * r.asleep, r.pulseLatency,
+             r.wallSeconds > 0 ? r.simSeconds / r.wallSeconds : 0);
+    }
+  }
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr,
+            "usage: %s [-p profile,...] [-n seeds] [-H hours] [-s step_us] [-c us_per_pass] [-e average|interval|change] [-k drift] [-d threshold] [-V watts] [-j jobs] [traces...]\n"
+            "       %s -g profile [-S seed] [-H hours] [-o file]\n", argv0, argv0);
+    exit(2);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> profiles;
+  std::string generate;
+  const char *output = "-";
+  int seeds = 1;
+  uint32_t seed = 1;
+  double hours = 2;
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  Options options;
+  options.step = 1000;
+  options.cost = 200;
+  options.estimator = -1;
+  options.drift = CHANGE_DRIFT;
+  options.threshold = CHANGE_THRESHOLD;
+  options.vacuum = 1500;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:n:H:s:c:e:k:d:V:j:g:S:o:")) != -1) {
+    switch (opt) {
+      case 'p': {
+        std::string list = optarg;
+        size_t start = 0, comma;
+        while ((comma = list.find(',', start)) != std::string::npos) {
+          profiles.push_back(list.substr(start, comma - start));
+          start = comma + 1;
+        }
+        profiles.push_back(list.substr(start));
+        break;
+      }
+      case 'n': seeds = atoi(optarg); break;
+      case 'H': hours = atof(optarg); break;
+      case 's': options.step = strtoull(optarg, NULL, 10); break;
+      case 'c': options.cost = strtoull(optarg, NULL, 10); break;
+      case 'e':
+        if (strcmp(optarg, "average") == 0) options.estimator = PowerMeter::ESTIMATE_AVERAGE;
+        else if (strcmp(optarg, "interval") == 0) options.estimator = PowerMeter::ESTIMATE_INTERVAL;
+        else if (strcmp(optarg, "change") == 0) options.estimator = PowerMeter::ESTIMATE_CHANGE;
+        else usage(argv[0]);
+        break;
+      case 'k': options.drift = atol(optarg); break;
+      case 'd': options.threshold = atol(optarg); break;
+      case 'V': options.vacuum = atof(optarg); break;
+      case 'j': jobs = atoi(optarg); break;
+      case 'g': generate = optarg; break;
+      case 'S': seed = strtoul(optarg, NULL, 10); break;
+      case 'o': output = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (options.step == 0) options.step = 1;
+  if (jobs < 1) jobs = 1;
+
+  if (!generate.empty()) {
+    Trace trace;
+    if (!generateTrace(generate, seed, hours, trace)) {
+      fprintf(stderr, "unknown profile '%s'\n", generate.c_str());
+      return 2;
+    }
+    return saveTrace(output, trace) ? 0 : 1;
+  }
+
+  std::vector<Trace> traces;
+  for (int i = optind; i < argc; i++) {
+    Trace trace;
+    if (!loadTrace(argv[i], trace)) {
+      fprintf(stderr, "can't read %s\n", argv[i]);
+      return 1;
+    }
+    traces.push_back(trace);
+  }
+  if (traces.empty() && profiles.empty()) profiles = traceProfiles();
+  for (size_t p = 0; p < profiles.size(); p++) {
+    for (int s = 0; s < seeds; s++) {
+      Trace trace;
+      if (!generateTrace(profiles[p], seed + s, hours, trace)) {
+        fprintf(stderr, "unknown profile '%s'\n", profiles[p].c_str());
+        return 2;
+      }
+      traces.push_back(trace);
+    }
+  }
+
+  report(replayAll(traces, options, jobs));
+  return 0;
+}
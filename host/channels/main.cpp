@@ -0,0 +1,233 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Measures what a pass of the control loop costs as channels are added.
+//
+// For 1 to -c channels, each with its own meter and tools switching on
+// and off at random, the channel stages of loop() are run without
+// sleeping, a millisecond of simulated time per pass. The wall-clock
+// cost per pass is fitted to a straight line in the channel count, and
+// scaled by -x to estimate the cost on the AVR, which is compared with
+// the budget -b.
+//
+// The -x default is a rough figure for a 16MHz AVR, which does its
+// floating point in software, against a desktop core. It is only good
+// for spotting a loop that is far over or under budget; timings on the
+// board itself come from the firmware's LOOP_TIMING histograms.
+//
+//   autovac_channels [-c channels] [-e extractors] [-t seconds] [-w watts]
+//                    [-r repeats] [-b budget_us] [-x slowdown] [-S seed]
+
+#include <ArduinoHost.h>
+#include "Channel.h"
+#include "Debouncer.h"
+#include "EventLog.h"
+#include "Timers.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  const uint8_t FIRST_METER_PIN = 20;
+  const uint8_t FIRST_RELAY_PIN = 50;
+  const uint64_t SECOND = 1000000;
+  const uint64_t STEP = 1000;          // Simulated time per pass.
+  const uint64_t PULSE_WIDTH = 30000;  // S0 outputs hold each pulse for at least 30ms.
+  const double WATT_US_PER_PULSE = 0.5 * 3600000.0 * 1000.0;
+
+  struct Options
+  {
+    int extractors;
+    double seconds;
+    double watts;
+    int repeats;
+    uint32_t seed;
+  };
+
+  struct Result
+  {
+    int channels;
+    double nsPerPass;
+    unsigned long relayOns;
+  };
+
+  unsigned long relayOns;
+
+  void relayWritten(uint8_t pin, uint8_t level, void *)
+  {
+    if (pin >= FIRST_RELAY_PIN && level == LOW) relayOns++;
+  }
+
+  // The tool on a channel runs for 5-60s, then stands for 5-120s.
+  void scheduleLoad(uint8_t pin, const Options &options, uint32_t &seed)
+  {
+    uint64_t end = (uint64_t)(options.seconds * SECOND);
+    uint64_t interval = (uint64_t)(WATT_US_PER_PULSE / options.watts);
+    uint64_t at = (5 + rand_r(&seed) % 120) * SECOND;
+    while (at < end) {
+      uint64_t stop = at + (5 + rand_r(&seed) % 55) * SECOND;
+      for (; at < stop && at < end; at += interval) {
+        HostPins::schedule(at, pin, LOW);
+        HostPins::schedule(at + PULSE_WIDTH, pin, HIGH);
+      }
+      at = stop + (5 + rand_r(&seed) % 115) * SECOND;
+    }
+  }
+
+  double run(int count, const Options &options)
+  {
+    hostReset();
+    HostSerial::setSink(NULL, NULL);
+    HostPins::onWrite(relayWritten, NULL);
+
+    std::vector<ChannelConfig> configs(count);
+    std::vector<Extractor> extractors(options.extractors);
+    for (int e = 0; e < options.extractors; e++) {
+      extractors[e].attach(FIRST_RELAY_PIN + e);
+    }
+
+    timers.tick();
+    uint32_t seed = options.seed;
+    Channel *channels = new Channel[count];
+    for (int i = 0; i < count; i++) {
+      ChannelConfig &config = configs[i];
+      config.meterPin = FIRST_METER_PIN + i;
+      config.overridePin = NO_PIN;
+      config.extractor = i % options.extractors;
+      config.estimator = PowerMeter::ESTIMATE_AVERAGE;
+      config.clamp = NULL;
+      config.powerLed = NULL;
+      config.overrideLed = NULL;
+      HostPins::set(config.meterPin, HIGH);
+      channels[i].begin(i, config, extractors[config.extractor], true);
+      scheduleLoad(config.meterPin, options, seed);
+    }
+
+    uint64_t end = (uint64_t)(options.seconds * SECOND);
+    uint64_t passes = 0;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    while (HostClock::now() < end) {
+      uint32_t now = timers.tick();
+      timers.run();
+      inputs.update(now);
+      for (int i = 0; i < count; i++) channels[i].updateMeter();
+      for (int i = 0; i < count; i++) channels[i].updateState(now);
+      eventLog.drain();
+      HostClock::advance(STEP);
+      passes++;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    delete[] channels;
+    return wall * 1e9 / passes;
+  }
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr, "usage: %s [-c channels] [-e extractors] [-t seconds] [-w watts] [-r repeats] [-b budget_us] [-x slowdown] [-S seed]\n", argv0);
+    exit(2);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  int maxChannels = CHANNEL_MAX;
+  double budget = 1000;
+  double slowdown = 300;
+  Options options;
+  options.extractors = 2;
+  options.seconds = 600;
+  options.watts = 1200;
+  options.repeats = 3;
+  options.seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:e:t:w:r:b:x:S:")) != -1) {
+    switch (opt) {
+      case 'c': maxChannels = atoi(optarg); break;
+      case 'e': options.extractors = atoi(optarg); break;
+      case 't': options.seconds = atof(optarg); break;
+      case 'w': options.watts = atof(optarg); break;
+      case 'r': options.repeats = atoi(optarg); break;
+      case 'b': budget = atof(optarg); break;
+      case 'x': slowdown = atof(optarg); break;
+      case 'S': options.seed = strtoul(optarg, NULL, 10); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (maxChannels < 1 || maxChannels > CHANNEL_MAX) {
+    fprintf(stderr, "channels must be 1-%d\n", CHANNEL_MAX);
+    return 2;
+  }
+  if (options.extractors < 1) options.extractors = 1;
+  if (options.watts <= 0) options.watts = 1;
+  if (options.repeats < 1) options.repeats = 1;
+
+  // The fastest of the repeats is the least disturbed by the host.
+  std::vector<Result> results;
+  for (int n = 1; n <= maxChannels; n++) {
+    Result r;
+    r.channels = n;
+    r.nsPerPass = 0;
+    relayOns = 0;
+    for (int i = 0; i < options.repeats; i++) {
+      double ns = run(n, options);
+      if (i == 0 || ns < r.nsPerPass) r.nsPerPass = ns;
+    }
+    r.relayOns = relayOns / options.repeats;
+    results.push_back(r);
+  }
+
+  // Least squares fit of the cost per pass to a + b * channels.
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    double x = results[i].channels, y = results[i].nsPerPass;
+    sx += x; sy += y; sxx += x * x; sxy += x * y;
+  }
+  double n = results.size();
+  double slope = n > 1 ? (n * sxy - sx * sy) / (n * sxx - sx * sx) : 0;
+  double base = (sy - slope * sx) / n;
+  double residual = 0, total = 0, worst = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    double fit = base + slope * results[i].channels;
+    double y = results[i].nsPerPass;
+    residual += (y - fit) * (y - fit);
+    total += (y - sy / n) * (y - sy / n);
+    worst = fmax(worst, fabs(y - fit) / fit);
+  }
+  double r2 = total > 0 ? 1 - residual / total : 1;
+
+  printf("%8s %10s %12s %12s %9s %8s\n", "channels", "ns/pass", "ns/channel", "est.AVR us", "budget", "relay on");
+  bool within = true;
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    double avr = r.nsPerPass * slowdown / 1000;
+    within = within && avr <= budget;
+    printf("%8d %10.0f %12.0f %12.0f %8.0f%% %8lu\n", r.channels, r.nsPerPass, r.nsPerPass / r.channels,
+           avr, 100 * avr / budget, r.relayOns);
+  }
+  printf("\nfit: %.0fns + %.0fns per channel, r^2 %.3f, worst deviation %.1f%%\n", base, slope, r2, 100 * worst);
+  printf("budget: %s at %d channels (%.0fus, x%.0f)\n", within ? "within" : "OVER", maxChannels, budget, slowdown);
+  return within ? 0 : 1;
+}
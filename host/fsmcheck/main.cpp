@@ -0,0 +1,714 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Checks the channel state machine against the rules the vacuum has to
+// keep, over random or every possible sequence of inputs:
+//
+//   relay      the relay is on in the running states, and only in them
+//   disarmed   while disarmed, the relay is only on in manual_running
+//   mode       armed, the channel is in an auto state; disarmed, a manual one
+//   dropped    no event is lost from the machine's queue
+//   cycling    the tool alone never switches the relay twice within COOLDOWN
+//   false start  the vacuum only comes on by itself when the tool is on
+//   stuck on   armed, the vacuum goes off once the tool has been off for
+//              3 x COOLDOWN, unless it was forced on
+//   stuck off  armed, the vacuum comes on once the tool has been on for
+//              3 x COOLDOWN, unless the override button turned it off
+//              since the tool was last switched
+//
+// Each run drives a real Channel, with its table, actions and timers,
+// through a series of steps. A step waits a while, with the loop waking
+// at every timer deadline on the way as it would on the board, and then
+// changes some inputs. Each loop pass runs the timers and gives the
+// machine what the loop would: the armed switch, the override button and
+// the power level. The level comes from a model of the circuit, in which
+// the tool and the vacuum each draw one step of power, so either alone
+// reads as power_tool and both together as power_high. The meter sees
+// the relay one pass late. With -g, that share of steps post a random
+// level instead, as a noisy meter would.
+//
+// Every invocation also starts the channel from each state a snapshot
+// can restore, with the armed switch either way, and checks the relay
+// before the first loop pass as well as after it.
+//
+// A run stops at its first broken rule, and the input sequence is then
+// shrunk to the shortest one that still breaks it. The runs are shared
+// out between forked processes, as the firmware is a set of globals.
+//
+//   autovac_fsmcheck [-n runs] [-l steps] [-g percent] [-j jobs] [-S seed]
+//   autovac_fsmcheck -x depth [-j jobs]
+//
+// -x tries every sequence of depth single-input steps instead, from
+// both positions of the armed switch.
+
+#include <ArduinoHost.h>
+#include "Channel.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  const uint8_t RELAY_PIN = Board::RELAY_PIN;
+  const uint32_t SETTLED = 3 * COOLDOWN;
+  const int MAX_TRACE = 64;
+  const int SHRINKS = 16;            // Violations of each rule a job shrinks.
+
+  enum Check {
+    CHECK_RELAY,
+    CHECK_DISARMED,
+    CHECK_MODE,
+    CHECK_DROPPED,
+    CHECK_CYCLING,
+    CHECK_FALSE_START,
+    CHECK_STUCK_ON,
+    CHECK_STUCK_OFF,
+    CHECK_COUNT
+  };
+
+  const char *CHECKS[] = {
+    "relay on outside the running states",
+    "relay on while disarmed",
+    "armed switch and mode disagree",
+    "event dropped",
+    "relay switched twice within COOLDOWN by the tool alone",
+    "vacuum started with the tool off",
+    "vacuum left on after the tool stopped",
+    "vacuum left off while the tool runs",
+  };
+  static_assert(sizeof(CHECKS) / sizeof(CHECKS[0]) == CHECK_COUNT, "Every check needs a description");
+
+  const char *STATES[] = {
+    "manual_idle", "manual_running", "auto_idle", "auto_running",
+    "auto_forced_running", "auto_forced_stopped", "auto_cooling_down",
+  };
+  static_assert(sizeof(STATES) / sizeof(STATES[0]) == STATE_COUNT, "Every state needs a name");
+
+  const char *LEVELS[] = { "power_tool", "power_high", "power_low" };
+
+  // What happens in one step, after waiting `wait` ms.
+  enum Input {
+    INPUT_ARM = 1,      // Flip the armed switch.
+    INPUT_OVERRIDE = 2, // Press the override button.
+    INPUT_TOOL = 4,     // Switch the tool on or off.
+    INPUT_GLITCH = 8    // The meter reads `level` instead of the model's.
+  };
+
+  struct Step
+  {
+    uint32_t wait;
+    uint8_t inputs;
+    uint8_t level;
+  };
+
+  struct Trace
+  {
+    bool armed;
+    uint8_t restored;  // The snapshot's state; STATE_COUNT to start without one.
+    uint8_t length;
+    Step steps[MAX_TRACE];
+  };
+
+  struct Found
+  {
+    unsigned long count;
+    bool shrunk;
+    Trace trace;
+  };
+
+  struct Result
+  {
+    unsigned long long runs;
+    unsigned long long passes;
+    double wallSeconds;
+    Found found[CHECK_COUNT];
+  };
+
+  struct Options
+  {
+    unsigned long runs;
+    int length;
+    int glitch;
+    int depth;
+    uint32_t seed;
+  };
+
+  bool vacuumState(State_type state)
+  {
+    return state == STATE_MANUAL_RUNNING || state == STATE_AUTO_RUNNING || state == STATE_AUTO_FORCED_RUNNING;
+  }
+
+  // A channel on the host, wired to a modelled tool circuit.
+  class Rig
+  {
+    public:
+      Rig(bool armed, uint8_t restored)
+      {
+        hostReset();
+        HostSerial::setSink(NULL, NULL);
+        timers.tick();
+
+        _config.meterPin = NO_PIN;
+        _config.overridePin = NO_PIN;
+        _config.extractor = 0;
+        _config.estimator = PowerMeter::ESTIMATE_AVERAGE;
+        _config.clamp = NULL;
+        _config.powerLed = NULL;
+        _config.overrideLed = NULL;
+        _extractor.attach(RELAY_PIN);
+        ChannelSnapshot snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        snapshot.state = restored;
+        _channel.begin(0, _config, _extractor, armed, restored < STATE_COUNT ? &snapshot : NULL);
+
+        // Until the first pass the armed level is still queued, so only
+        // the relay can be checked.
+        _armed = armed;
+        _startState = state();
+        _startRelay = relay();
+        _started = CHECK_COUNT;
+        if(_startRelay != vacuumState(_startState)) {
+          _started = CHECK_RELAY;
+        } else if(!armed && _startRelay && _startState != STATE_MANUAL_RUNNING) {
+          _started = CHECK_DISARMED;
+        }
+        _tool = false;
+        _relay = false;
+        _level = EVENT_POWER_LOW;
+        _channel.machine().post(_level);
+        _channel.machine().dispatch();
+        _relay = relay();
+        _switched = false;
+        _switchedByTool = false;
+        _userSinceSwitch = false;
+        _forcedOff = false;
+        _switchedAt = 0;
+        _quietSince = 0;
+        _quietPasses = 0;
+        _passes = 0;
+      }
+
+      // Runs the loop passes of one step, and returns the first rule
+      // they broke, or CHECK_COUNT.
+      Check step(const Step &step)
+      {
+        uint64_t end = HostClock::now() + (uint64_t)step.wait * 1000;
+        uint32_t at;
+        while(timers.nextDeadline(at) && (uint64_t)at * 1000 < end) {
+          HostClock::advanceTo((uint64_t)at * 1000);
+          Check check = pass(IDLE);
+          if(check != CHECK_COUNT) {
+            return check;
+          }
+        }
+        HostClock::advanceTo(end);
+        return pass(step);
+      }
+
+      Check started() { return _started; }
+      State_type startState() { return _startState; }
+      bool startRelay() { return _startRelay; }
+      State_type state() { return _channel.state(); }
+      bool relay() { return HostPins::output(RELAY_PIN) == LOW; } // The relay is active low.
+      unsigned long passes() { return _passes; }
+
+    private:
+      static const Step IDLE;
+
+      Check pass(const Step &step)
+      {
+        _passes++;
+        uint32_t now = timers.tick();
+        timers.run();
+
+        StateMachine &fsm = _channel.machine();
+        if(step.inputs & (INPUT_ARM | INPUT_OVERRIDE)) {
+          _userSinceSwitch = true;
+        }
+        if(step.inputs & INPUT_ARM) {
+          _armed = !_armed;
+          _channel.armed(_armed);
+        }
+        if(step.inputs & INPUT_OVERRIDE) {
+          fsm.post(EVENT_OVERRIDE);
+        }
+        if(step.inputs & (INPUT_ARM | INPUT_TOOL)) {
+          _forcedOff = false;
+        }
+        if(step.inputs & INPUT_TOOL) {
+          _tool = !_tool;
+        }
+        Event_type level = (step.inputs & INPUT_GLITCH) ? (Event_type)step.level : modelLevel();
+        if(level != _level) {
+          _level = level;
+          fsm.post(level);
+        }
+        fsm.dispatch();
+
+        if(step.inputs != 0) {
+          _quietSince = now;
+          _quietPasses = 0;
+        } else {
+          _quietPasses++;
+        }
+
+        bool on = relay();
+        State_type state = _channel.state();
+        if(on != _relay) {
+          bool byTool = !_userSinceSwitch;
+          bool tooSoon = byTool && _switched && _switchedByTool && now - _switchedAt < COOLDOWN;
+          _switched = true;
+          _switchedByTool = byTool;
+          _switchedAt = now;
+          _userSinceSwitch = false;
+          _forcedOff = !on && (step.inputs & INPUT_OVERRIDE);
+          _relay = on;
+          if(tooSoon) {
+            return CHECK_CYCLING;
+          }
+          if(on && state == STATE_AUTO_RUNNING && !_tool && !(step.inputs & INPUT_GLITCH)) {
+            return CHECK_FALSE_START;
+          }
+        }
+
+        if(on != vacuumState(state)) {
+          return CHECK_RELAY;
+        }
+        if(!_armed && on && state != STATE_MANUAL_RUNNING) {
+          return CHECK_DISARMED;
+        }
+        if(_armed != (state >= STATE_AUTO_IDLE)) {
+          return CHECK_MODE;
+        }
+        if(fsm.droppedEvents() != 0) {
+          return CHECK_DROPPED;
+        }
+        if(_armed && _quietPasses >= 2 && now - _quietSince >= SETTLED) {
+          if(!_tool && on && state != STATE_AUTO_FORCED_RUNNING) {
+            return CHECK_STUCK_ON;
+          }
+          if(_tool && !on && !_forcedOff) {
+            return CHECK_STUCK_OFF;
+          }
+        }
+        return CHECK_COUNT;
+      }
+
+      Event_type modelLevel()
+      {
+        int steps = (_tool ? 1 : 0) + (_relay ? 1 : 0);
+        return steps == 0 ? EVENT_POWER_LOW : (steps == 1 ? EVENT_POWER_TOOL : EVENT_POWER_HIGH);
+      }
+
+      ChannelConfig _config;
+      Extractor _extractor;
+      Channel _channel;
+      Check _started;
+      State_type _startState;
+      bool _startRelay;
+      bool _armed;
+      bool _tool;
+      bool _relay;     // As the meter last saw it.
+      Event_type _level;
+      bool _switched;
+      bool _switchedByTool;
+      bool _userSinceSwitch;
+      bool _forcedOff;
+      uint32_t _switchedAt;
+      uint32_t _quietSince;
+      unsigned _quietPasses;
+      unsigned long _passes;
+  };
+
+  const Step Rig::IDLE = { 0, 0, 0 };
+
+  // Replays the trace, and returns the first rule broken, the number of
+  // steps it took and the loop passes they ran.
+  Check replay(const Trace &trace, int &steps, unsigned long &passes)
+  {
+    Rig rig(trace.armed, trace.restored);
+    Check check = rig.started();
+    for(steps = 0; steps < trace.length && check == CHECK_COUNT; steps++) {
+      check = rig.step(trace.steps[steps]);
+    }
+    passes = rig.passes();
+    return check;
+  }
+
+  bool breaks(const Trace &trace, Check check)
+  {
+    int steps;
+    unsigned long passes;
+    return replay(trace, steps, passes) == check;
+  }
+
+  // Greedily drops steps, then inputs, then shortens waits, for as long
+  // as the same rule still breaks first.
+  void shrink(Trace &trace, Check check)
+  {
+    int steps;
+    unsigned long passes;
+    replay(trace, steps, passes);
+    trace.length = steps;
+
+    bool smaller = true;
+    while(smaller) {
+      smaller = false;
+      for(int i = trace.length - 1; i >= 0; i--) {
+        Trace t = trace;
+        memmove(&t.steps[i], &t.steps[i + 1], (t.length - i - 1) * sizeof(Step));
+        t.length--;
+        if(breaks(t, check)) {
+          trace = t;
+          smaller = true;
+        }
+      }
+      for(int i = 0; i < trace.length; i++) {
+        for(uint8_t bit = 1; bit <= INPUT_GLITCH; bit <<= 1) {
+          Trace t = trace;
+          t.steps[i].inputs &= ~bit;
+          if((trace.steps[i].inputs & bit) && breaks(t, check)) {
+            trace = t;
+            smaller = true;
+          }
+        }
+      }
+      for(int i = 0; i < trace.length; i++) {
+        const uint32_t candidates[] = { 0, COOLDOWN, trace.steps[i].wait / 2, trace.steps[i].wait - 1 };
+        for(size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+          Trace t = trace;
+          t.steps[i].wait = candidates[c];
+          if(candidates[c] < trace.steps[i].wait && breaks(t, check)) {
+            trace = t;
+            smaller = true;
+          }
+        }
+      }
+    }
+  }
+
+  uint64_t traceTime(const Trace &trace)
+  {
+    uint64_t total = 0;
+    for(int i = 0; i < trace.length; i++) total += trace.steps[i].wait;
+    return total;
+  }
+
+  // Keeps the shortest trace for each rule, and then the one taking the
+  // least time.
+  void keep(Found &found, const Trace &trace, bool shrunk)
+  {
+    if(found.count == 0 || trace.length < found.trace.length
+       || (trace.length == found.trace.length && traceTime(trace) < traceTime(found.trace))) {
+      found.trace = trace;
+      found.shrunk = shrunk;
+    }
+  }
+
+  void record(Result &result, Trace trace, Check check)
+  {
+    Found &found = result.found[check];
+    bool shrunk = found.count < SHRINKS;
+    if(shrunk) {
+      shrink(trace, check);
+    }
+    keep(found, trace, shrunk);
+    found.count++;
+  }
+
+  // Random steps: mostly short gaps, with waits near COOLDOWN and long
+  // idle spells mixed in, where the timers do their work.
+  Step randomStep(uint32_t &seed, int glitch)
+  {
+    Step step;
+    int r = rand_r(&seed) % 10;
+    if(r < 4) {
+      step.wait = rand_r(&seed) % 50;
+    } else if(r < 7) {
+      step.wait = COOLDOWN - 2 + rand_r(&seed) % 5;
+    } else {
+      step.wait = rand_r(&seed) % (SETTLED + 1);
+    }
+    step.inputs = 0;
+    if(rand_r(&seed) % 100 < 5) step.inputs |= INPUT_ARM;
+    if(rand_r(&seed) % 100 < 10) step.inputs |= INPUT_OVERRIDE;
+    if(rand_r(&seed) % 100 < 25) step.inputs |= INPUT_TOOL;
+    if(rand_r(&seed) % 100 < glitch) step.inputs |= INPUT_GLITCH;
+    step.level = EVENT_POWER_TOOL + rand_r(&seed) % 3;
+    return step;
+  }
+
+  Result fuzz(unsigned long runs, uint32_t seed, const Options &options)
+  {
+    Result result;
+    memset(&result, 0, sizeof(result));
+    Trace trace;
+    trace.restored = STATE_COUNT;
+    for(unsigned long run = 0; run < runs; run++) {
+      trace.armed = rand_r(&seed) % 4 != 0;
+      trace.length = options.length;
+      for(int i = 0; i < trace.length; i++) {
+        trace.steps[i] = randomStep(seed, options.glitch);
+      }
+      int steps;
+      unsigned long passes;
+      Check check = replay(trace, steps, passes);
+      result.runs++;
+      result.passes += passes;
+      if(check != CHECK_COUNT) {
+        record(result, trace, check);
+      }
+    }
+    return result;
+  }
+
+  // The single-input steps -x builds its sequences from.
+  const Step MOVES[] = {
+    { 0, INPUT_ARM, 0 },
+    { 0, INPUT_OVERRIDE, 0 },
+    { 0, INPUT_TOOL, 0 },
+    { 1, 0, 0 },             // Lets the meter catch up with the relay.
+    { COOLDOWN / 2, 0, 0 },
+    { COOLDOWN, 0, 0 },
+  };
+  const int MOVE_COUNT = sizeof(MOVES) / sizeof(MOVES[0]);
+
+  // Every sequence that starts with the job's armed position and first
+  // two moves.
+  Result exhaust(int job, const Options &options)
+  {
+    Result result;
+    memset(&result, 0, sizeof(result));
+    Trace trace;
+    trace.armed = job / (MOVE_COUNT * MOVE_COUNT);
+    trace.restored = STATE_COUNT;
+    trace.length = options.depth;
+    int moves[MAX_TRACE] = { 0 };
+    moves[0] = job / MOVE_COUNT % MOVE_COUNT;
+    moves[1] = job % MOVE_COUNT;
+
+    while(true) {
+      for(int i = 0; i < trace.length; i++) {
+        trace.steps[i] = MOVES[moves[i]];
+      }
+      int steps;
+      unsigned long passes;
+      Check check = replay(trace, steps, passes);
+      result.runs++;
+      result.passes += passes;
+      if(check != CHECK_COUNT) {
+        record(result, trace, check);
+      }
+
+      int i = trace.length - 1;
+      while(i >= 2 && ++moves[i] == MOVE_COUNT) {
+        moves[i--] = 0;
+      }
+      if(i < 2) {
+        break;
+      }
+    }
+    return result;
+  }
+
+  // Starts from each state a snapshot can hold, with the armed switch
+  // either way, and then leaves the tool off or switches it on and lets
+  // the timers run until everything should have settled.
+  Result restores()
+  {
+    Result result;
+    memset(&result, 0, sizeof(result));
+    Trace trace;
+    trace.length = 3;
+    for(uint8_t state = 0; state < STATE_COUNT; state++) {
+      for(int armed = 0; armed < 2; armed++) {
+        for(int tool = 0; tool < 2; tool++) {
+          trace.armed = armed;
+          trace.restored = state;
+          for(int i = 0; i < trace.length; i++) {
+            trace.steps[i].wait = i == 0 ? 1 : SETTLED;
+            trace.steps[i].inputs = i == 0 && tool ? INPUT_TOOL : 0;
+            trace.steps[i].level = 0;
+          }
+          int steps;
+          unsigned long passes;
+          Check check = replay(trace, steps, passes);
+          result.runs++;
+          result.passes += passes;
+          if(check != CHECK_COUNT) {
+            record(result, trace, check);
+          }
+        }
+      }
+    }
+    return result;
+  }
+
+  void merge(Result &total, const Result &r)
+  {
+    total.runs += r.runs;
+    total.passes += r.passes;
+    for(int c = 0; c < CHECK_COUNT; c++) {
+      if(r.found[c].count == 0) continue;
+      keep(total.found[c], r.found[c].trace, r.found[c].shrunk);
+      total.found[c].count += r.found[c].count;
+    }
+  }
+
+  // Runs the jobs in child processes, `jobs` at a time, and merges their
+  // results as they come back through pipes.
+  Result runAll(int count, const Options &options, int jobs)
+  {
+    Result total;
+    memset(&total, 0, sizeof(total));
+    std::vector<std::pair<pid_t, int> > running;
+    int next = 0;
+
+    while(next < count || !running.empty()) {
+      while(next < count && (int)running.size() < jobs) {
+        int fds[2];
+        if(pipe(fds) != 0) { perror("pipe"); exit(1); }
+        pid_t pid = fork();
+        if(pid == 0) {
+          close(fds[0]);
+          std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+          Result r;
+          if(options.depth > 0) {
+            r = exhaust(next, options);
+          } else {
+            unsigned long runs = options.runs / count + (next < (int)(options.runs % count) ? 1 : 0);
+            r = fuzz(runs, options.seed + next * 7919, options);
+          }
+          r.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+          ssize_t written = write(fds[1], &r, sizeof(r));
+          _exit(written == (ssize_t)sizeof(r) ? 0 : 1);
+        }
+        close(fds[1]);
+        running.push_back(std::make_pair(pid, fds[0]));
+        next++;
+      }
+
+      std::pair<pid_t, int> job = running.front();
+      running.erase(running.begin());
+      Result r;
+      if(read(job.second, &r, sizeof(r)) != (ssize_t)sizeof(r)) {
+        fprintf(stderr, "a job failed\n");
+        exit(1);
+      }
+      close(job.second);
+      waitpid(job.first, NULL, 0);
+      merge(total, r);
+      total.wallSeconds += r.wallSeconds;
+    }
+    return total;
+  }
+
+  void printTrace(const Trace &trace)
+  {
+    Rig rig(trace.armed, trace.restored);
+    char start[48];
+    snprintf(start, sizeof(start), "%s%s%s", trace.armed ? "armed" : "disarmed",
+             trace.restored < STATE_COUNT ? " from " : "",
+             trace.restored < STATE_COUNT ? STATES[trace.restored] : "");
+    if(rig.started() != CHECK_COUNT) {
+      printf("    start %-26s %s, relay %s\n", start, STATES[rig.startState()], rig.startRelay() ? "on" : "off");
+      return;
+    }
+    printf("    start %-26s %s, relay %s\n", start, STATES[rig.state()], rig.relay() ? "on" : "off");
+    for(int i = 0; i < trace.length; i++) {
+      const Step &step = trace.steps[i];
+      char inputs[64] = "";
+      if(step.inputs & INPUT_ARM) strcat(inputs, "arm ");
+      if(step.inputs & INPUT_OVERRIDE) strcat(inputs, "override ");
+      if(step.inputs & INPUT_TOOL) strcat(inputs, "tool ");
+      if(step.inputs & INPUT_GLITCH) {
+        strcat(inputs, LEVELS[step.level - EVENT_POWER_TOOL]);
+      }
+      rig.step(step);
+      printf("    +%-6ums %-24s -> %s, relay %s\n", (unsigned)step.wait, inputs,
+             STATES[rig.state()], rig.relay() ? "on" : "off");
+    }
+  }
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr, "usage: %s [-n runs] [-l steps] [-g percent] [-j jobs] [-S seed]\n"
+                    "       %s -x depth [-j jobs]\n", argv0, argv0);
+    exit(2);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  Options options;
+  options.runs = 200000;
+  options.length = 40;
+  options.glitch = 0;
+  options.depth = 0;
+  options.seed = 1;
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:l:g:x:j:S:")) != -1) {
+    switch(opt) {
+      case 'n': options.runs = strtoul(optarg, NULL, 10); break;
+      case 'l': options.length = atoi(optarg); break;
+      case 'g': options.glitch = atoi(optarg); break;
+      case 'x': options.depth = atoi(optarg); break;
+      case 'j': jobs = atoi(optarg); break;
+      case 'S': options.seed = strtoul(optarg, NULL, 10); break;
+      default: usage(argv[0]);
+    }
+  }
+  if(options.length < 1 || options.length > MAX_TRACE || options.depth < 0 || options.depth > MAX_TRACE
+     || (options.depth > 0 && options.depth < 2)) {
+    fprintf(stderr, "steps and depth must be 2-%d\n", MAX_TRACE);
+    return 2;
+  }
+  if(jobs < 1) jobs = 1;
+
+  // Enough jobs to keep every process busy to the end.
+  int count = options.depth > 0 ? 2 * MOVE_COUNT * MOVE_COUNT : jobs * 4;
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  Result total = runAll(count, options, jobs);
+  merge(total, restores());
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  printf("%llu runs, %llu passes in %.1fs, %.2fM passes/s (%.2fM per process)\n",
+         total.runs, total.passes, wall, total.passes / wall / 1e6,
+         total.wallSeconds > 0 ? total.passes / total.wallSeconds / 1e6 : 0);
+
+  bool clean = true;
+  for(int c = 0; c < CHECK_COUNT; c++) {
+    const Found &found = total.found[c];
+    if(found.count == 0) continue;
+    clean = false;
+    printf("\n%s: %lu runs%s\n", CHECKS[c], found.count, found.shrunk ? "" : " (trace not shrunk)");
+    printTrace(found.trace);
+  }
+  if(clean) {
+    printf("no rule broken\n");
+  }
+  return clean ? 0 : 1;
+}
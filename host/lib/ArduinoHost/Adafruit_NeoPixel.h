@@ -0,0 +1,67 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Host version of Adafruit_NeoPixel. Copies share the pixel buffer,
+// like the real library's shallow copy of its pixel pointer, and
+// show() only counts the frames that would have been sent.
+
+#ifndef ADAFRUIT_NEOPIXEL_H
+#define ADAFRUIT_NEOPIXEL_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#define NEO_RGB 0x06
+#define NEO_GRB 0x52
+#define NEO_KHZ800 0x0000
+#define NEO_KHZ400 0x0100
+
+typedef uint16_t neoPixelType;
+
+class Adafruit_NeoPixel
+{
+public:
+  Adafruit_NeoPixel(uint16_t n = 0, uint8_t pin = 6, neoPixelType type = NEO_GRB + NEO_KHZ800)
+    : _pixels(new std::vector<uint32_t>(n, 0)), _pin(pin), _brightness(0) { (void)type; }
+
+  void begin() { pinMode(_pin, OUTPUT); }
+  void show();
+  bool canShow() { return true; }
+
+  void setPixelColor(uint16_t n, uint32_t c) { if (n < _pixels->size()) (*_pixels)[n] = c; }
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) { setPixelColor(n, Color(r, g, b)); }
+  uint32_t getPixelColor(uint16_t n) const { return n < _pixels->size() ? (*_pixels)[n] : 0; }
+  void setBrightness(uint8_t b) { _brightness = b; }
+  uint8_t getBrightness() const { return _brightness; }
+  uint16_t numPixels() const { return (uint16_t)_pixels->size(); }
+  void clear() { std::fill(_pixels->begin(), _pixels->end(), 0); }
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b)
+  {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+private:
+  std::shared_ptr<std::vector<uint32_t> > _pixels;
+  uint8_t _pin;
+  uint8_t _brightness;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Host (native) stand-in for the Arduino core. Only the parts of the
+// API the firmware actually uses are provided; time and pins are
+// simulated and controlled through ArduinoHost.h.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+
+#define ARDUINO_HOST 1
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define NOT_AN_INTERRUPT -1
+#define NUM_DIGITAL_PINS 70
+#define A0 54 // The analog inputs follow the digital pins, as on the Mega.
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// The AVR millis()/micros() counters are 32 bits wide and wrap; keep
+// that behaviour on the host rather than using a 64 bit unsigned long.
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+int analogRead(uint8_t pin);
+
+// The AVR's ADC can convert over and over, interrupting with each
+// result. There are no ADC registers on the host, so the firmware starts
+// that here instead: isr gets a reading of the pin every periodMicros of
+// virtual time, until it is called again with a NULL isr.
+void hostAdcFreeRun(uint8_t pin, uint32_t periodMicros, void (*isr)(uint16_t value));
+
+// Pins are grouped eight to a port, in pin order, with PORTA as 1 as on
+// the AVR (0 is NOT_A_PORT). The input register follows the pin levels.
+#define NOT_A_PORT 0
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t *portInputRegister(uint8_t port);
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+void noInterrupts();
+void interrupts();
+
+// The Arduino core defines these as macros; templates keep them usable
+// next to the C++ standard library in host tools.
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <typename A, typename L, typename H>
+inline A constrain(A a, L lo, H hi) { return a < lo ? lo : (a > hi ? hi : a); }
+
+#define F(s) (s)
+
+#include "HardwareSerial.h"
+
+#endif
@@ -0,0 +1,518 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "ArduinoHost.h"
+#include <Adafruit_NeoPixel.h>
+#include <avr/sleep.h>
+#include <EEPROM.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+
+#define HOST_PORTS ((NUM_DIGITAL_PINS + 7) / 8 + 1)
+
+namespace
+{
+  struct PinState
+  {
+    uint8_t mode;
+    uint8_t input;
+    uint8_t output;
+    bool driven;
+    int analog;
+    HostPins::AnalogSource source;
+    void *sourceContext;
+    void (*isr)(void);
+    int isrMode;
+  };
+
+  struct PinEvent
+  {
+    uint8_t pin;
+    uint8_t level;
+  };
+
+  struct HostState
+  {
+    uint64_t now;
+    PinState pins[NUM_DIGITAL_PINS];
+    volatile uint8_t ports[HOST_PORTS];
+    std::multimap<uint64_t, PinEvent> events;
+    HostPins::WriteHook writeHook;
+    void *writeContext;
+    HostSerial::Sink sink;
+    void *sinkContext;
+    std::deque<uint8_t> rx;
+    int writeSpace;
+    uint64_t bytesWritten;
+    uint64_t byteTime;
+    uint64_t txBusyUntil;
+    uint64_t txBlocked;
+    uint64_t shows;
+    uint64_t sleeps;
+    uint64_t slept;
+    uint8_t eeprom[E2END + 1];
+    uint64_t eepromWrites;
+    uint8_t adcPin;
+    uint32_t adcPeriod;
+    void (*adcIsr)(uint16_t);
+    uint64_t adcNext;
+
+    HostState() { reset(0); }
+
+    void reset(uint64_t start)
+    {
+      now = start;
+      memset(pins, 0, sizeof(pins));
+      for (int i = 0; i < HOST_PORTS; i++) ports[i] = 0;
+      events.clear();
+      writeHook = NULL;
+      writeContext = NULL;
+      sink = stdoutSink;
+      sinkContext = NULL;
+      rx.clear();
+      writeSpace = 63;
+      bytesWritten = 0;
+      byteTime = 0;
+      txBusyUntil = 0;
+      txBlocked = 0;
+      shows = 0;
+      sleeps = 0;
+      slept = 0;
+      memset(eeprom, 0xFF, sizeof(eeprom));
+      eepromWrites = 0;
+      adcPin = 0;
+      adcPeriod = 0;
+      adcIsr = NULL;
+      adcNext = 0;
+    }
+
+    // Bytes still waiting in the transmit buffer.
+    int txQueued() const
+    {
+      if (byteTime == 0 || txBusyUntil <= now) return 0;
+      return (int)((txBusyUntil - now + byteTime - 1) / byteTime);
+    }
+
+    static void stdoutSink(const uint8_t *data, size_t length, void *)
+    {
+      fwrite(data, 1, length, stdout);
+    }
+  };
+
+  thread_local HostState host;
+
+  uint8_t levelOf(const PinState &p)
+  {
+    if (p.driven) return p.input;
+    return p.mode == INPUT_PULLUP ? HIGH : LOW;
+  }
+
+  // Copies the pin's level into its port's input register.
+  void latch(uint8_t pin)
+  {
+    const PinState &p = host.pins[pin];
+    uint8_t level = p.mode == OUTPUT ? p.output : levelOf(p);
+    uint8_t mask = digitalPinToBitMask(pin);
+    volatile uint8_t &port = host.ports[digitalPinToPort(pin)];
+    port = level ? (port | mask) : (port & ~mask);
+  }
+
+  void drive(uint8_t pin, uint8_t level, bool driven)
+  {
+    if (pin >= NUM_DIGITAL_PINS) return;
+    PinState &p = host.pins[pin];
+    uint8_t before = levelOf(p);
+    p.input = level ? HIGH : LOW;
+    p.driven = driven;
+    latch(pin);
+    uint8_t after = levelOf(p);
+    if (p.isr == NULL || before == after) return;
+    if (p.isrMode == CHANGE
+        || (p.isrMode == RISING && after == HIGH)
+        || (p.isrMode == FALLING && after == LOW)) {
+      p.isr();
+    }
+  }
+}
+
+
+uint32_t millis() { return (uint32_t)(host.now / 1000); }
+uint32_t micros() { return (uint32_t)host.now; }
+void delay(uint32_t ms) { HostClock::advance((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { HostClock::advance(us); }
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= NUM_DIGITAL_PINS) return;
+  host.pins[pin].mode = mode;
+  latch(pin);
+}
+
+int digitalRead(uint8_t pin)
+{
+  if (pin >= NUM_DIGITAL_PINS) return LOW;
+  const PinState &p = host.pins[pin];
+  return p.mode == OUTPUT ? p.output : levelOf(p);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin >= NUM_DIGITAL_PINS) return;
+  host.pins[pin].output = val ? HIGH : LOW;
+  latch(pin);
+  if (host.writeHook) host.writeHook(pin, host.pins[pin].output, host.writeContext);
+}
+
+int analogRead(uint8_t pin)
+{
+  if (pin >= NUM_DIGITAL_PINS) return 0;
+  const PinState &p = host.pins[pin];
+  return p.source ? p.source(pin, host.now, p.sourceContext) : p.analog;
+}
+
+void hostAdcFreeRun(uint8_t pin, uint32_t periodMicros, void (*isr)(uint16_t value))
+{
+  host.adcPin = pin;
+  host.adcPeriod = periodMicros ? periodMicros : 1;
+  host.adcIsr = isr;
+  host.adcNext = host.now + host.adcPeriod;
+}
+
+uint8_t digitalPinToPort(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? pin / 8 + 1 : NOT_A_PORT; }
+uint8_t digitalPinToBitMask(uint8_t pin) { return 1 << (pin % 8); }
+volatile uint8_t *portInputRegister(uint8_t port) { return port < HOST_PORTS ? &host.ports[port] : NULL; }
+
+// Every pin can interrupt on the host; interrupt numbers are pin numbers.
+int digitalPinToInterrupt(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? pin : NOT_AN_INTERRUPT; }
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode)
+{
+  if (interruptNum >= NUM_DIGITAL_PINS) return;
+  host.pins[interruptNum].isr = isr;
+  host.pins[interruptNum].isrMode = mode;
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+  if (interruptNum < NUM_DIGITAL_PINS) host.pins[interruptNum].isr = NULL;
+}
+
+// Interrupts only fire while the host advances the clock, never in the
+// middle of firmware code, so there is nothing to mask.
+void noInterrupts() {}
+void interrupts() {}
+
+
+uint64_t HostClock::now() { return host.now; }
+
+void HostClock::reset(uint64_t startMicros)
+{
+  host.now = startMicros;
+  host.events.clear();
+  host.adcNext = startMicros + host.adcPeriod;
+}
+
+void HostClock::advance(uint64_t micros)
+{
+  advanceTo(host.now + micros);
+}
+
+// Pin changes and ADC conversions fire in time order; a pin change due
+// at the same moment as a conversion goes first.
+void HostClock::advanceTo(uint64_t micros)
+{
+  for (;;) {
+    bool pin = !host.events.empty() && host.events.begin()->first <= micros;
+    bool adc = host.adcIsr != NULL && host.adcNext <= micros;
+    if (adc && (!pin || host.adcNext < host.events.begin()->first)) {
+      if (host.adcNext > host.now) host.now = host.adcNext;
+      host.adcNext += host.adcPeriod;
+      host.adcIsr((uint16_t)analogRead(host.adcPin));
+    } else if (pin) {
+      std::multimap<uint64_t, PinEvent>::iterator next = host.events.begin();
+      PinEvent e = next->second;
+      if (next->first > host.now) host.now = next->first;
+      host.events.erase(next);
+      drive(e.pin, e.level, true);
+    } else {
+      break;
+    }
+  }
+  if (micros > host.now) host.now = micros;
+}
+
+bool HostClock::nextEvent(uint64_t &at)
+{
+  bool any = false;
+  if (!host.events.empty()) {
+    at = host.events.begin()->first;
+    any = true;
+  }
+  if (host.adcIsr != NULL && (!any || host.adcNext < at)) {
+    at = host.adcNext;
+    any = true;
+  }
+  return any;
+}
+
+
+void HostPins::set(uint8_t pin, uint8_t level) { drive(pin, level, true); }
+
+void HostPins::release(uint8_t pin)
+{
+  if (pin < NUM_DIGITAL_PINS) drive(pin, host.pins[pin].input, false);
+}
+
+void HostPins::schedule(uint64_t atMicros, uint8_t pin, uint8_t level)
+{
+  PinEvent e = { pin, level };
+  host.events.insert(std::make_pair(atMicros, e));
+}
+
+uint8_t HostPins::output(uint8_t pin)
+{
+  return pin < NUM_DIGITAL_PINS ? host.pins[pin].output : LOW;
+}
+
+void HostPins::onWrite(WriteHook hook, void *context)
+{
+  host.writeHook = hook;
+  host.writeContext = context;
+}
+
+void HostPins::setAnalog(uint8_t pin, int value)
+{
+  if (pin < NUM_DIGITAL_PINS) host.pins[pin].analog = value;
+}
+
+void HostPins::analogSource(uint8_t pin, AnalogSource source, void *context)
+{
+  if (pin >= NUM_DIGITAL_PINS) return;
+  host.pins[pin].source = source;
+  host.pins[pin].sourceContext = context;
+}
+
+
+void HostSerial::setSink(Sink sink, void *context)
+{
+  host.sink = sink;
+  host.sinkContext = context;
+}
+
+void HostSerial::toStdout() { setSink(HostState::stdoutSink, NULL); }
+
+void HostSerial::inject(const char *text)
+{
+  inject((const uint8_t *)text, strlen(text));
+}
+
+void HostSerial::inject(const uint8_t *data, size_t length)
+{
+  host.rx.insert(host.rx.end(), data, data + length);
+}
+
+void HostSerial::setWriteSpace(int bytes) { host.writeSpace = bytes; }
+
+uint64_t HostSerial::bytesWritten() { return host.bytesWritten; }
+
+uint64_t HostSerial::blocked() { return host.txBlocked; }
+
+
+void set_sleep_mode(uint8_t) {}
+
+void sleep_cpu()
+{
+  const uint64_t TIMER0_OVERFLOW = 1024;
+  uint64_t wake = (host.now / TIMER0_OVERFLOW + 1) * TIMER0_OVERFLOW;
+  uint64_t event;
+  if (HostClock::nextEvent(event) && event < wake) wake = event;
+  host.sleeps++;
+  host.slept += wake - host.now;
+  HostClock::advanceTo(wake);
+}
+
+uint64_t HostSleep::sleeps() { return host.sleeps; }
+uint64_t HostSleep::slept() { return host.slept; }
+
+
+uint64_t HostNeoPixel::shows() { return host.shows; }
+
+void Adafruit_NeoPixel::show() { host.shows++; }
+
+
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int idx)
+{
+  return idx >= 0 && idx <= E2END ? host.eeprom[idx] : 0xFF;
+}
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+  if (idx < 0 || idx > E2END) return;
+  host.eeprom[idx] = val;
+  host.eepromWrites++;
+}
+
+void EEPROMClass::update(int idx, uint8_t val)
+{
+  if (read(idx) != val) write(idx, val);
+}
+
+uint8_t *HostEEPROM::data() { return host.eeprom; }
+uint64_t HostEEPROM::writes() { return host.eepromWrites; }
+
+
+void hostReset() { host.reset(0); }
+
+
+HardwareSerial Serial;
+
+// Ten bit times per byte: start, eight data bits and stop.
+void HardwareSerial::begin(unsigned long baud)
+{
+  host.byteTime = baud ? 10000000ULL / baud : 0;
+}
+
+void HardwareSerial::end() {}
+int HardwareSerial::available() { return (int)host.rx.size(); }
+int HardwareSerial::peek() { return host.rx.empty() ? -1 : host.rx.front(); }
+
+int HardwareSerial::read()
+{
+  if (host.rx.empty()) return -1;
+  int c = host.rx.front();
+  host.rx.pop_front();
+  return c;
+}
+
+int HardwareSerial::availableForWrite()
+{
+  int space = host.writeSpace - host.txQueued();
+  return space > 0 ? space : 0;
+}
+
+void HardwareSerial::flush() {}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+// Like the real driver, a full transmit buffer makes write() wait for the
+// UART; the wait passes on the virtual clock, so pin events still fire.
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (host.byteTime) {
+    for (size_t i = 0; i < size; i++) {
+      if (host.txQueued() >= host.writeSpace) {
+        uint64_t room = host.txBusyUntil - host.writeSpace * host.byteTime;
+        host.txBlocked += room - host.now;
+        HostClock::advanceTo(room);
+      }
+      host.txBusyUntil = (host.txBusyUntil > host.now ? host.txBusyUntil : host.now) + host.byteTime;
+    }
+  }
+  host.bytesWritten += size;
+  if (host.sink) host.sink(buffer, size, host.sinkContext);
+  return size;
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::write(const char *str)
+{
+  return str ? write((const uint8_t *)str, strlen(str)) : 0;
+}
+
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base)
+{
+  if (base == DEC && n < 0) {
+    return print('-') + printNumber(0UL - (unsigned long)n, DEC);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(double n, int digits) { return printFloat(n, digits); }
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const char str[]) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    unsigned long m = n;
+    n /= base;
+    char c = (char)(m - base * n);
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::printFloat(double number, uint8_t digits)
+{
+  if (isnan(number)) return print("nan");
+  if (isinf(number)) return print("inf");
+
+  size_t n = 0;
+  if (number < 0.0) {
+    n += print('-');
+    number = -number;
+  }
+
+  double rounding = 0.5;
+  for (uint8_t i = 0; i < digits; ++i) rounding /= 10.0;
+  number += rounding;
+
+  unsigned long whole = (unsigned long)number;
+  double remainder = number - (double)whole;
+  n += print(whole);
+  if (digits > 0) n += print('.');
+  while (digits-- > 0) {
+    remainder *= 10.0;
+    unsigned int digit = (unsigned int)remainder;
+    n += print(digit);
+    remainder -= digit;
+  }
+  return n;
+}
@@ -0,0 +1,126 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Control surface for the host HAL. Host programs use this to drive the
+// virtual clock, the simulated pins and the serial port that the
+// firmware sees through Arduino.h.
+//
+// All simulation state is thread local, so independent simulations can
+// run on separate threads of the same process.
+
+#ifndef ArduinoHost_h
+#define ArduinoHost_h
+
+#include <Arduino.h>
+#include <stddef.h>
+
+namespace HostClock
+{
+  // Microseconds since the simulation started, without wrapping.
+  uint64_t now();
+
+  // Restart the clock at the given time and forget scheduled events.
+  void reset(uint64_t startMicros = 0);
+
+  // Move time forward, firing every scheduled pin change, and every
+  // conversion of a free-running ADC, on the way.
+  void advance(uint64_t micros);
+  void advanceTo(uint64_t micros);
+
+  // Time of the earliest scheduled pin change or ADC conversion, if
+  // there is one.
+  bool nextEvent(uint64_t &at);
+}
+
+namespace HostPins
+{
+  typedef void (*WriteHook)(uint8_t pin, uint8_t level, void *context);
+  typedef int (*AnalogSource)(uint8_t pin, uint64_t atMicros, void *context);
+
+  // Drive an input from outside, as the wiring would. Edges fire any
+  // interrupt attached to the pin.
+  void set(uint8_t pin, uint8_t level);
+
+  // Stop driving an input; it falls back to its pull-up state.
+  void release(uint8_t pin);
+
+  // Queue a call to set() for a later point on the virtual clock.
+  void schedule(uint64_t atMicros, uint8_t pin, uint8_t level);
+
+  // Last level the firmware wrote to an output.
+  uint8_t output(uint8_t pin);
+
+  // Observe every digitalWrite() the firmware makes.
+  void onWrite(WriteHook hook, void *context);
+
+  void setAnalog(uint8_t pin, int value);
+
+  // A waveform for an analog input instead of a fixed value: analogRead()
+  // and the free-running ADC call source for the reading at that time.
+  // A NULL source goes back to the setAnalog() value.
+  void analogSource(uint8_t pin, AnalogSource source, void *context);
+}
+
+namespace HostSerial
+{
+  typedef void (*Sink)(const uint8_t *data, size_t length, void *context);
+
+  // Where firmware output goes. A null sink discards it.
+  void setSink(Sink sink, void *context);
+  void toStdout();
+
+  // Queue bytes for the firmware to read().
+  void inject(const char *text);
+  void inject(const uint8_t *data, size_t length);
+
+  // Size of the transmit buffer. After Serial.begin() it drains at the
+  // baud rate, and write() blocks on the virtual clock while it is full.
+  void setWriteSpace(int bytes);
+
+  uint64_t bytesWritten();
+
+  // Virtual time write() has spent waiting for transmit buffer space.
+  uint64_t blocked();
+}
+
+namespace HostSleep
+{
+  // Number of sleep_cpu() calls, and virtual time spent asleep.
+  uint64_t sleeps();
+  uint64_t slept();
+}
+
+namespace HostNeoPixel
+{
+  uint64_t shows();
+}
+
+namespace HostEEPROM
+{
+  // The EEPROM contents, E2END + 1 bytes, for inspecting or preloading.
+  uint8_t *data();
+
+  // Number of bytes actually written; update() of an unchanged byte
+  // doesn't count, as it doesn't wear the cell.
+  uint64_t writes();
+}
+
+// Reset the clock, pins, serial port, EEPROM and counters of this thread.
+void hostReset();
+
+#endif
@@ -0,0 +1,55 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Host version of the AVR core's EEPROM library. The contents belong to
+// the calling thread, start erased (0xFF) and are inspected through
+// HostEEPROM in ArduinoHost.h.
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+class EEPROMClass
+{
+public:
+  uint8_t read(int idx);
+  void write(int idx, uint8_t val);
+  void update(int idx, uint8_t val);
+  uint16_t length() { return E2END + 1; }
+
+  template <typename T> T &get(int idx, T &t)
+  {
+    uint8_t *p = (uint8_t *)&t;
+    for (unsigned i = 0; i < sizeof(T); i++) p[i] = read(idx + i);
+    return t;
+  }
+
+  template <typename T> const T &put(int idx, const T &t)
+  {
+    const uint8_t *p = (const uint8_t *)&t;
+    for (unsigned i = 0; i < sizeof(T); i++) update(idx + i, p[i]);
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,119 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "LogFrames.h"
+#include <string.h>
+#include <util/crc16.h>
+
+namespace
+{
+  bool readVarint(const uint8_t *&p, const uint8_t *end, uint32_t &value)
+  {
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+      uint8_t byte = *p++;
+      value |= (uint32_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+}
+
+
+LogFrameReader::LogFrameReader()
+  : _length(0), _overlong(false), _synced(false), _frames(0), _bad(0), _skipped(0)
+{
+}
+
+
+bool LogFrameReader::feed(uint8_t byte, LogRecord &record)
+{
+  if (byte != 0) {
+    if (_length < sizeof(_frame)) {
+      _frame[_length++] = byte;
+    } else {
+      _overlong = true;
+    }
+    return false;
+  }
+
+  bool good = !_overlong && decode(record);
+  if (good) {
+    _frames++;
+  } else if (!_synced) {
+    _skipped += _length + 1;
+  } else {
+    _bad++;
+  }
+  _synced = true;
+  _length = 0;
+  _overlong = false;
+  return good;
+}
+
+
+unsigned long LogFrameReader::frames() const
+{
+  return _frames;
+}
+
+
+unsigned long LogFrameReader::bad() const
+{
+  return _bad;
+}
+
+
+unsigned long LogFrameReader::skipped() const
+{
+  return _skipped;
+}
+
+
+// Undoes the COBS in place, checks the CRC, then unpacks the varints.
+bool LogFrameReader::decode(LogRecord &record)
+{
+  if (_length < 2) return false;
+  uint8_t packed[LOG_FRAME_PACKED];
+  size_t n = 0;
+  size_t code = 0;
+  while (code < _length) {
+    size_t next = code + _frame[code];
+    if (next > _length) return false;
+    for (size_t i = code + 1; i < next; i++) packed[n++] = _frame[i];
+    if (next < _length) packed[n++] = 0;
+    code = next;
+  }
+  if (n < 4) return false;
+
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < n - 2; i++) crc = _crc_ccitt_update(crc, packed[i]);
+  if (packed[n - 2] != (uint8_t)crc || packed[n - 1] != (uint8_t)(crc >> 8)) return false;
+
+  const uint8_t *p = packed + 1;
+  const uint8_t *end = packed + n - 2;
+  record.id = packed[0];
+  if (!readVarint(p, end, record.time)) return false;
+  memset(record.args, 0, sizeof(record.args));
+  for (int arg = 0; p < end; arg++) {
+    uint32_t value;
+    if (arg == LOG_FRAME_ARGS || !readVarint(p, end, value)) return false;
+    record.args[arg] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+  }
+  return true;
+}
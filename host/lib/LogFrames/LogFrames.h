@@ -0,0 +1,66 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Reads the firmware's event log frames (see src/EventLog.h) out of a
+// stream of serial bytes.
+//
+// Bytes are fed in one at a time, and a record comes out whenever one
+// completes a frame whose CRC and layout are good. If what comes before
+// the first zero doesn't decode, the reader joined part way through a
+// frame, and those bytes are counted as skipped; after that, a frame
+// that doesn't decode is counted as bad. Either way the reader carries
+// on from the next zero.
+
+#ifndef LogFrames_h
+#define LogFrames_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_FRAME_ARGS   3
+#define LOG_FRAME_PACKED (1 + 5 + 5 * LOG_FRAME_ARGS + 2)
+
+struct LogRecord
+{
+  uint8_t id;
+  uint32_t time;
+  int32_t args[LOG_FRAME_ARGS];
+};
+
+class LogFrameReader
+{
+  public:
+    LogFrameReader();
+    bool feed(uint8_t byte, LogRecord &record);
+    unsigned long frames() const;
+    unsigned long bad() const;
+    unsigned long skipped() const;
+
+  private:
+    bool decode(LogRecord &record);
+
+    uint8_t _frame[LOG_FRAME_PACKED + 1];
+    size_t _length;
+    bool _overlong;
+    bool _synced;
+    unsigned long _frames;
+    unsigned long _bad;
+    unsigned long _skipped;
+};
+
+#endif
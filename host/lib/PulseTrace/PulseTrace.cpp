@@ -0,0 +1,336 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "PulseTrace.h"
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  const double WH_PER_PULSE = 0.5;
+  const uint64_t STEP = 10000;               // Integration step, us.
+  const double HOURS_PER_STEP = STEP / 3600e6;
+  const uint64_t SECOND = 1000000;
+
+  // A load that is either off or drawing `watts`, switched on and off on
+  // a fixed schedule of [start, stop) intervals.
+  struct Load
+  {
+    double watts;
+    double noise;     // Relative standard deviation of the draw.
+    bool labelled;    // The tool under test; gets ON/OFF labels.
+    std::vector<std::pair<uint64_t, uint64_t> > runs;
+  };
+
+  typedef std::mt19937 Random;
+
+  double uniform(Random &rng, double lo, double hi)
+  {
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+  }
+
+  uint64_t seconds(double s) { return (uint64_t)(s * SECOND); }
+
+  // Sessions of `runs` separated by idle gaps, e.g. a batch of cuts.
+  void schedule(Load &load, Random &rng, uint64_t end,
+                double runMin, double runMax, double pauseMin, double pauseMax,
+                int batchMin, int batchMax, double gapMin, double gapMax)
+  {
+    uint64_t t = seconds(uniform(rng, gapMin, gapMax) / 4);
+    while (t < end) {
+      int batch = std::uniform_int_distribution<int>(batchMin, batchMax)(rng);
+      for (int i = 0; i < batch && t < end; i++) {
+        uint64_t stop = t + seconds(uniform(rng, runMin, runMax));
+        load.runs.push_back(std::make_pair(t, std::min(stop, end)));
+        t = stop + seconds(uniform(rng, pauseMin, pauseMax));
+      }
+      t += seconds(uniform(rng, gapMin, gapMax));
+    }
+  }
+
+  // A load that cycles on and off all day, like a fridge.
+  void cycle(Load &load, Random &rng, uint64_t end, double onMin, double onMax, double offMin, double offMax)
+  {
+    uint64_t t = seconds(uniform(rng, 0, offMax));
+    while (t < end) {
+      uint64_t stop = t + seconds(uniform(rng, onMin, onMax));
+      load.runs.push_back(std::make_pair(t, std::min(stop, end)));
+      t = stop + seconds(uniform(rng, offMin, offMax));
+    }
+  }
+
+  Load makeLoad(double watts, double noise, bool labelled)
+  {
+    Load load;
+    load.watts = watts;
+    load.noise = noise;
+    load.labelled = labelled;
+    return load;
+  }
+
+  // Integrates the loads into meter pulses. Noisy circuits also get
+  // contact bounce after some pulses and the odd isolated spurious edge.
+  void render(const std::vector<Load> &loads, uint64_t end, bool noisy, Random &rng, Trace &trace)
+  {
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    std::vector<size_t> next(loads.size(), 0);
+    std::vector<double> wobble(loads.size(), 1.0);
+    double energy = 0;
+
+    for (size_t i = 0; i < loads.size(); i++) {
+      if (!loads[i].labelled) continue;
+      for (size_t r = 0; r < loads[i].runs.size(); r++) {
+        TraceEvent on = { loads[i].runs[r].first, TraceEvent::TOOL_ON };
+        TraceEvent off = { loads[i].runs[r].second, TraceEvent::TOOL_OFF };
+        trace.events.push_back(on);
+        trace.events.push_back(off);
+      }
+    }
+
+    for (uint64_t t = 0; t < end; t += STEP) {
+      double watts = 0;
+      for (size_t i = 0; i < loads.size(); i++) {
+        const Load &load = loads[i];
+        while (next[i] < load.runs.size() && load.runs[next[i]].second <= t) next[i]++;
+        if (next[i] >= load.runs.size() || load.runs[next[i]].first > t) continue;
+        if (load.noise > 0 && t % (10 * STEP) == 0) {
+          wobble[i] = std::max(0.0, 1.0 + load.noise * gauss(rng));
+        }
+        watts += load.watts * wobble[i];
+      }
+
+      energy += watts * HOURS_PER_STEP;
+      if (energy >= WH_PER_PULSE) {
+        energy -= WH_PER_PULSE;
+        uint64_t at = t + (uint64_t)uniform(rng, 0, STEP);
+        TraceEvent pulse = { at, TraceEvent::PULSE };
+        trace.events.push_back(pulse);
+        if (noisy && uniform(rng, 0, 1) < 0.3) {
+          TraceEvent bounce = { at + (uint64_t)uniform(rng, 200, 5000), TraceEvent::PULSE };
+          trace.events.push_back(bounce);
+        }
+      }
+      if (noisy && uniform(rng, 0, 1) < STEP / (600.0 * SECOND)) {
+        TraceEvent glitch = { t, TraceEvent::PULSE };
+        trace.events.push_back(glitch);
+      }
+    }
+    trace.sort();
+  }
+}
+
+
+void Trace::sort()
+{
+  std::stable_sort(events.begin(), events.end(),
+                   [](const TraceEvent &a, const TraceEvent &b) { return a.time < b.time; });
+}
+
+
+bool loadTrace(const char *path, Trace &trace)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) return false;
+
+  trace.name = path;
+  trace.events.clear();
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    unsigned long long time;
+    char kind[8];
+    if (sscanf(line, "%llu %7s", &time, kind) != 2) continue;
+    TraceEvent e;
+    e.time = time;
+    if (strcmp(kind, "P") == 0) e.kind = TraceEvent::PULSE;
+    else if (strcmp(kind, "ON") == 0) e.kind = TraceEvent::TOOL_ON;
+    else if (strcmp(kind, "OFF") == 0) e.kind = TraceEvent::TOOL_OFF;
+    else continue;
+    trace.events.push_back(e);
+  }
+  fclose(f);
+  trace.sort();
+  return true;
+}
+
+
+bool saveTrace(const char *path, const Trace &trace)
+{
+  FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (f == NULL) return false;
+
+  fprintf(f, "# AutoVac pulse trace: %s\n", trace.name.c_str());
+  static const char *kinds[] = { "P", "ON", "OFF" };
+  for (size_t i = 0; i < trace.events.size(); i++) {
+    fprintf(f, "%llu %s\n", (unsigned long long)trace.events[i].time, kinds[trace.events[i].kind]);
+  }
+  return f == stdout ? fflush(f) == 0 : fclose(f) == 0;
+}
+
+
+std::vector<std::string> traceProfiles()
+{
+  std::vector<std::string> profiles;
+  profiles.push_back("saw");
+  profiles.push_back("sander");
+  profiles.push_back("background");
+  profiles.push_back("idle");
+  return profiles;
+}
+
+
+bool generateTrace(const std::string &profile, uint32_t seed, double hours, Trace &trace)
+{
+  Random rng(seed);
+  uint64_t end = (uint64_t)(hours * 3600 * SECOND);
+  std::vector<Load> loads;
+  bool noisy = false;
+
+  Load standby = makeLoad(30, 0, false);
+  standby.runs.push_back(std::make_pair(0, end));
+  loads.push_back(standby);
+
+  if (profile == "saw") {
+    Load saw = makeLoad(1800, 0.05, true);
+    schedule(saw, rng, end, 4, 20, 2, 8, 4, 12, 120, 600);
+    loads.push_back(saw);
+  } else if (profile == "sander") {
+    Load sander = makeLoad(900, 0.15, true);
+    schedule(sander, rng, end, 30, 180, 5, 30, 2, 6, 180, 900);
+    loads.push_back(sander);
+    noisy = true;
+  } else if (profile == "background" || profile == "idle") {
+    if (profile == "background") {
+      Load router = makeLoad(700, 0.08, true);
+      schedule(router, rng, end, 10, 60, 3, 15, 3, 8, 120, 600);
+      loads.push_back(router);
+    }
+    Load fridge = makeLoad(150, 0.05, false);
+    cycle(fridge, rng, end, 300, 900, 600, 1800);
+    loads.push_back(fridge);
+    Load lights = makeLoad(200, 0, false);
+    cycle(lights, rng, end, 1800, 7200, 60, 600);
+    loads.push_back(lights);
+    Load heater = makeLoad(400, 0.02, false);
+    cycle(heater, rng, end, 60, 300, 600, 2400);
+    loads.push_back(heater);
+  } else {
+    return false;
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "%s-%u", profile.c_str(), (unsigned)seed);
+  trace.name = name;
+  trace.events.clear();
+  render(loads, end, noisy, rng, trace);
+  return true;
+}
+
+
+std::vector<std::pair<uint64_t, uint64_t> > pulseEdges(const Trace &trace, uint64_t width)
+{
+  std::vector<std::pair<uint64_t, uint64_t> > edges;
+  uint64_t previous = 0;
+  for (size_t i = 0; i < trace.events.size(); i++) {
+    const TraceEvent &e = trace.events[i];
+    if (e.kind != TraceEvent::PULSE) continue;
+    uint64_t fall = e.time > width ? e.time - width : 0;
+    if (fall <= previous) fall = previous + (e.time - previous) / 2;
+    edges.push_back(std::make_pair(fall, e.time));
+    previous = e.time;
+  }
+  return edges;
+}
+
+
+std::vector<uint64_t> pulseTimes(const Trace &trace)
+{
+  std::vector<uint64_t> pulses;
+  for (size_t i = 0; i < trace.events.size(); i++) {
+    if (trace.events[i].kind == TraceEvent::PULSE) pulses.push_back(trace.events[i].time);
+  }
+  return pulses;
+}
+
+
+uint64_t clearOfPulses(const std::vector<uint64_t> &pulses, uint64_t at, uint64_t width, uint64_t gap)
+{
+  while (true) {
+    std::vector<uint64_t>::const_iterator near =
+      std::upper_bound(pulses.begin(), pulses.end(), at > gap ? at - gap : 0);
+    if (near == pulses.end() || *near > at + 2 * width + gap) return at;
+    at = *near + gap;
+  }
+}
+
+
+RelayScore scoreRelay(const Trace &trace, const std::vector<std::pair<uint64_t, bool> > &changes, uint64_t grace)
+{
+  RelayScore score;
+  score.missed = 0;
+  score.falseStarts = 0;
+  score.relayOns = 0;
+
+  std::vector<std::pair<uint64_t, uint64_t> > runs;
+  for (size_t i = 0; i < trace.events.size(); i++) {
+    const TraceEvent &e = trace.events[i];
+    if (e.kind == TraceEvent::TOOL_ON) runs.push_back(std::make_pair(e.time, e.time));
+    if (e.kind == TraceEvent::TOOL_OFF && !runs.empty()) runs.back().second = e.time;
+  }
+  score.toolRuns = runs.size();
+
+  // Relay state at a point in time, and the next change after it.
+  for (size_t r = 0; r < runs.size(); r++) {
+    uint64_t start = runs[r].first, stop = runs[r].second;
+    uint64_t nextStart = r + 1 < runs.size() ? runs[r + 1].first : UINT64_MAX;
+
+    bool onAtStart = false;
+    size_t c = 0;
+    while (c < changes.size() && changes[c].first <= start) onAtStart = changes[c++].second;
+
+    uint64_t cameOn = onAtStart ? start : 0;
+    for (; !cameOn && c < changes.size() && changes[c].first <= stop + grace; c++) {
+      if (changes[c].second) cameOn = changes[c].first;
+    }
+    if (!cameOn) {
+      score.missed++;
+      continue;
+    }
+    score.onLatency.push_back((cameOn - start) / 1e6);
+
+    for (c = 0; c < changes.size(); c++) {
+      if (changes[c].first < std::max(stop, cameOn) || changes[c].second) continue;
+      if (changes[c].first < nextStart) score.offLatency.push_back((changes[c].first - stop) / 1e6);
+      break;
+    }
+  }
+
+  for (size_t c = 0; c < changes.size(); c++) {
+    if (!changes[c].second) continue;
+    score.relayOns++;
+    bool explained = false;
+    for (size_t r = 0; r < runs.size() && !explained; r++) {
+      explained = changes[c].first >= runs[r].first && changes[c].first <= runs[r].second + grace;
+    }
+    if (!explained) score.falseStarts++;
+  }
+  return score;
+}
@@ -0,0 +1,91 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Labelled meter pulse traces for the host tools.
+//
+// A trace is the list of rising edges the meter input would see, plus
+// labels for when the tool being watched was switched on and off. On
+// disk it is one event per line, "<microseconds> <kind>", where kind is
+// P (pulse edge), ON or OFF; '#' starts a comment.
+
+#ifndef PulseTrace_h
+#define PulseTrace_h
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct TraceEvent
+{
+  enum Kind {
+    PULSE,
+    TOOL_ON,
+    TOOL_OFF
+  };
+
+  uint64_t time;
+  Kind kind;
+};
+
+struct Trace
+{
+  std::string name;
+  std::vector<TraceEvent> events;
+
+  uint64_t duration() const { return events.empty() ? 0 : events.back().time; }
+  void sort();
+};
+
+bool loadTrace(const char *path, Trace &trace);
+bool saveTrace(const char *path, const Trace &trace);
+
+// Synthetic shop profiles:
+//   saw        - mitre/table saw cuts with short pauses between them
+//   sander     - long sanding runs on a circuit with noisy, bouncing pulses
+//   background - a small tool over cycling background loads (fridge,
+//                compressor, lights) that overlap the tool runs
+//   idle       - background loads only; every relay start is a false start
+std::vector<std::string> traceProfiles();
+bool generateTrace(const std::string &profile, uint32_t seed, double hours, Trace &trace);
+
+// Replaying a trace: the edges of each pulse, as (falling, rising) times
+// `width` apart, or squeezed in if the previous edge was very close; the
+// rising edge is the one counted. clearOfPulses() finds the first time at
+// or after `at` that an extra pulse fits `gap` clear of the trace's, whose
+// rising edges are `pulses`, in order.
+std::vector<std::pair<uint64_t, uint64_t> > pulseEdges(const Trace &trace, uint64_t width);
+std::vector<uint64_t> pulseTimes(const Trace &trace);
+uint64_t clearOfPulses(const std::vector<uint64_t> &pulses, uint64_t at, uint64_t width, uint64_t gap);
+
+// How well a vacuum relay followed the tool runs labelled in a trace,
+// given its switchings as (time, on), in order. A switch-on within
+// `grace` of the end of a run is late for it rather than false.
+struct RelayScore
+{
+  unsigned toolRuns;
+  unsigned missed;             // Runs the relay never came on for.
+  unsigned falseStarts;        // Switch-ons with no run to explain them.
+  unsigned relayOns;
+  std::vector<double> onLatency;  // Seconds from the start of a run to the relay on,
+  std::vector<double> offLatency; // and from its end to the relay off.
+};
+
+RelayScore scoreRelay(const Trace &trace, const std::vector<std::pair<uint64_t, bool> > &changes, uint64_t grace);
+
+#endif
@@ -0,0 +1,369 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Turns the firmware's binary event log (see src/EventLog.h) back into
+// text, or into CSV for loading elsewhere. Reads a capture of the serial
+// port, a pipe from it, or the port itself, or a pty standing in for it:
+//
+//   autovac_logdecode [-b baud] [-c | -o directory] [input]
+//   autovac_sim -t 600 -w 2000 | autovac_logdecode
+//   autovac_logdecode -b 115200 -o shift /dev/ttyACM0
+//
+//   -b  the baud rate, when the input is a terminal (default 9600)
+//   -c  write CSV: the time, the message name and its arguments, a
+//       record a line
+//   -o  write a CSV file per message into the directory, NAME.csv, with
+//       a column per argument named from the catalog format
+//
+// Times are the firmware's millis() in seconds, carried on past its
+// wrap. A terminal is read until it closes or the decoder is
+// interrupted, and the output is flushed as each read comes in.
+//
+// Frames that don't decode, or fail their CRC, are counted and skipped,
+// so decoding can start part way through a record.
+
+#include "EventLog.h"
+#include "LoopTiming.h"
+#include "StateTable.h"
+
+#include <LogFrames.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+static_assert(LOG_FRAME_ARGS == EVENT_LOG_ARGS, "LogFrames must unpack every argument");
+
+namespace
+{
+  // How a message's arguments are shown; see LogCatalog.h.
+  enum Arguments { NUMBERS, STATE, STAGE, HISTOGRAM };
+
+  enum Output { TEXT, CSV, TABLES };
+
+  struct Message
+  {
+    const char *name;
+    const char *format;
+    Arguments arguments;
+  };
+
+#define LOG_CATALOG_MESSAGE(id, name, format, arguments) { name, format, arguments },
+  const Message MESSAGES[] = {
+    LOG_CATALOG(LOG_CATALOG_MESSAGE)
+  };
+#undef LOG_CATALOG_MESSAGE
+
+  const char *STATES[] = {
+    "Manual Idle", "Manual Running", "Idle", "Running",
+    "Overriding on", "Overriding off", "Cooling Down",
+  };
+  static_assert(sizeof(STATES) / sizeof(STATES[0]) == STATE_COUNT,
+                "Every state needs a name");
+
+  const char *STAGES[] = {
+    "inputs", "meter", "state", "leds", "serial", "loop",
+  };
+  static_assert(sizeof(STAGES) / sizeof(STAGES[0]) == STAGE_COUNT,
+                "Every loop stage needs a name");
+
+  const int BUCKETS = 4 * EVENT_LOG_ARGS;
+
+  volatile sig_atomic_t interrupted = 0;
+
+  void interrupt(int)
+  {
+    interrupted = 1;
+  }
+
+  const char *name(const char **names, long count, long i)
+  {
+    return i >= 0 && i < count ? names[i] : "?";
+  }
+
+  unsigned bucket(const long *args, int i)
+  {
+    return (uint32_t)args[i / 4] >> (8 * (i % 4)) & 0xFF;
+  }
+
+  // Column names from a catalog format: the label in front of each
+  // conversion, with any unit straight after it tacked on, so that
+  // "start:%ldW" is start_W. An unlabelled state or stage is just that,
+  // and any other unlabelled argument is named by the word after it.
+  std::vector<std::string> columns(const Message &m)
+  {
+    std::vector<std::string> names;
+    if (m.arguments == HISTOGRAM) {
+      for (int i = 0; i < BUCKETS; i++) names.push_back("bucket" + std::to_string(i));
+      return names;
+    }
+    for (const char *p = m.format; (p = strchr(p, '%')) != NULL; ) {
+      const char *colon = p > m.format && p[-1] == ':' ? p - 1 : p;
+      const char *label = colon;
+      while (colon < p && label > m.format && isalnum((unsigned char)label[-1])) label--;
+      std::string column(label, colon - label);
+
+      while (*++p && !isalpha((unsigned char)*p)) {}
+      while (*p == 'l') p++;
+      bool text = *p == 's';
+      if (*p) p++;
+      const char *after = p;
+      while (isalpha((unsigned char)*p)) p++;
+
+      if (!column.empty()) {
+        if (p > after) column += "_" + std::string(after, p - after);
+      } else if (text) {
+        column = m.arguments == STATE ? "state" : "stage";
+      } else {
+        while (*after == ' ') after++;
+        for (p = after; isalpha((unsigned char)*p); p++) {}
+        column = p > after ? std::string(after, p - after) : "arg" + std::to_string(names.size() + 1);
+      }
+      names.push_back(column);
+    }
+    return names;
+  }
+
+  // The arguments as CSV fields, after the time and name.
+  void csvFields(FILE *out, const Message &m, const long *args)
+  {
+    if (m.arguments == HISTOGRAM) {
+      for (int i = 0; i < BUCKETS; i++) fprintf(out, ",%u", bucket(args, i));
+      return;
+    }
+    size_t count = columns(m).size();
+    for (size_t i = 0; i < count && i < EVENT_LOG_ARGS; i++) {
+      if (i == 0 && m.arguments == STATE) fprintf(out, ",%s", name(STATES, STATE_COUNT, args[0]));
+      else if (i == 0 && m.arguments == STAGE) fprintf(out, ",%s", name(STAGES, STAGE_COUNT, args[0]));
+      else fprintf(out, ",%ld", args[i]);
+    }
+  }
+
+  class Decoder
+  {
+    public:
+      Decoder(Output output, const char *directory)
+        : _output(output), _directory(directory), _base(0), _last(0), _tables(LOG_MESSAGE_COUNT, (FILE *)NULL)
+      {
+        if (_output == CSV) printf("time,message,arg1,arg2,arg3\n");
+      }
+
+      ~Decoder()
+      {
+        for (size_t i = 0; i < _tables.size(); i++) {
+          if (_tables[i]) fclose(_tables[i]);
+        }
+      }
+
+      void record(const LogRecord &record)
+      {
+        // A restart begins the clock again; otherwise a step back by more
+        // than half the range is millis() wrapping round.
+        if (record.id == LOG_STARTED) {
+          _base = 0;
+        } else if (record.time < _last && _last - record.time > 0x80000000u) {
+          _base += 1ULL << 32;
+        }
+        _last = record.time;
+        double time = (_base + record.time) / 1000.0;
+
+        long args[EVENT_LOG_ARGS];
+        for (int i = 0; i < EVENT_LOG_ARGS; i++) args[i] = record.args[i];
+        if (record.id >= LOG_MESSAGE_COUNT) {
+          if (_output == TEXT) printf("%10.3f id %u %ld %ld %ld\n", time, record.id, args[0], args[1], args[2]);
+          return;
+        }
+
+        const Message &m = MESSAGES[record.id];
+        if (_output == TEXT) {
+          print(time, m, args);
+        } else if (_output == CSV) {
+          printf("%.3f,%s", time, m.name);
+          csvFields(stdout, m, args);
+          printf("\n");
+        } else if (FILE *table = this->table(record.id)) {
+          fprintf(table, "%.3f", time);
+          csvFields(table, m, args);
+          fprintf(table, "\n");
+        }
+      }
+
+      void flush()
+      {
+        fflush(stdout);
+        for (size_t i = 0; i < _tables.size(); i++) {
+          if (_tables[i]) fflush(_tables[i]);
+        }
+      }
+
+    private:
+      void print(double time, const Message &m, const long *args)
+      {
+        printf("%10.3f %-8s ", time, m.name);
+        switch (m.arguments) {
+          case NUMBERS:
+            printf(m.format, args[0], args[1], args[2]);
+            break;
+          case STATE:
+            printf(m.format, name(STATES, STATE_COUNT, args[0]), args[1], args[2]);
+            break;
+          case STAGE:
+            printf(m.format, name(STAGES, STAGE_COUNT, args[0]), args[1], args[2]);
+            break;
+          case HISTOGRAM:
+            printf("%s", m.format);
+            for (int i = 0; i < BUCKETS; i++) printf(" %u", bucket(args, i));
+            break;
+        }
+        printf("\n");
+      }
+
+      // Opened, with its header, the first time the message turns up.
+      FILE *table(uint8_t id)
+      {
+        if (!_tables[id]) {
+          std::string path = std::string(_directory) + "/" + MESSAGES[id].name + ".csv";
+          _tables[id] = fopen(path.c_str(), "w");
+          if (!_tables[id]) {
+            perror(path.c_str());
+            exit(1);
+          }
+          fprintf(_tables[id], "time");
+          std::vector<std::string> names = columns(MESSAGES[id]);
+          for (size_t i = 0; i < names.size(); i++) fprintf(_tables[id], ",%s", names[i].c_str());
+          fprintf(_tables[id], "\n");
+        }
+        return _tables[id];
+      }
+
+      Output _output;
+      const char *_directory;
+      uint64_t _base;
+      uint32_t _last;
+      std::vector<FILE *> _tables;
+  };
+
+  speed_t speed(long baud)
+  {
+    switch (baud) {
+      case 9600: return B9600;
+      case 19200: return B19200;
+      case 38400: return B38400;
+      case 57600: return B57600;
+      case 115200: return B115200;
+      case 230400: return B230400;
+      case 500000: return B500000;
+      case 1000000: return B1000000;
+      default: return B0;
+    }
+  }
+
+  // Raw bytes at the firmware's rate, with nothing translated or echoed.
+  bool configure(int fd, long baud)
+  {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) return false;
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return cfsetispeed(&tio, speed(baud)) == 0 && cfsetospeed(&tio, speed(baud)) == 0
+        && tcsetattr(fd, TCSANOW, &tio) == 0;
+  }
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr, "usage: %s [-b baud] [-c | -o directory] [input]\n", argv0);
+    exit(2);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  long baud = 9600;
+  Output output = TEXT;
+  const char *directory = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:co:")) != -1) {
+    switch (opt) {
+      case 'b': baud = atol(optarg); break;
+      case 'c': output = CSV; break;
+      case 'o': output = TABLES; directory = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (argc - optind > 1) usage(argv[0]);
+  if (speed(baud) == B0) {
+    fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return 2;
+  }
+
+  int fd = STDIN_FILENO;
+  const char *input = optind < argc ? argv[optind] : "-";
+  if (strcmp(input, "-") != 0) {
+    fd = open(input, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(input);
+      return 1;
+    }
+  }
+  bool terminal = isatty(fd);
+  if (terminal && !configure(fd, baud)) {
+    perror(input);
+    return 1;
+  }
+  if (directory && mkdir(directory, 0777) != 0 && errno != EEXIST) {
+    perror(directory);
+    return 1;
+  }
+
+  // Without SA_RESTART, so that an interrupt ends a blocked read.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = interrupt;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  Decoder decoder(output, directory);
+  LogFrameReader reader;
+  LogRecord record;
+  uint8_t buffer[4096];
+  while (!interrupted) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    for (ssize_t i = 0; i < n; i++) {
+      if (reader.feed(buffer[i], record)) decoder.record(record);
+    }
+    if (terminal) decoder.flush();
+  }
+  decoder.flush();
+
+  fprintf(stderr, "%lu records, %lu bad frames, %lu bytes skipped\n", reader.frames(), reader.bad(), reader.skipped());
+  return 0;
+}
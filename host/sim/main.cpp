@@ -0,0 +1,132 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Runs the unmodified firmware against the host HAL, as fast as the
+// host allows. A constant load can be applied to the meter input, and as
+// a mains current to the CT clamp's, so the whole control loop is
+// exercised; the result is a plain Linux process
+// that perf, gprof or valgrind can look at.
+//
+//   autovac_sim [-t seconds] [-w watts] [-s step_us] [-c us_per_pass]
+//               [-W seconds] [-m] [-q]
+//
+//   -t  simulated run time (default 60s)
+//   -w  constant load on the meter and the clamp (default 0W)
+//   -s  virtual time that passes per loop() call, unless the firmware
+//       slept through some itself (default 100us)
+//   -c  virtual time charged for each loop() pass, as the firmware takes
+//       none of its own (default 200us); the asleep figure is only as
+//       good as this, so measure it with a LOOP_TIMING build
+//   -W  start the clock this long before millis() wraps round, to check
+//       that nothing minds the wrap
+//   -m  leave the arm switch in manual rather than auto
+//   -q  discard the firmware's serial output
+
+#include <ArduinoHost.h>
+#include "Board.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+// Wiring, from the board profile AutoVac.cpp takes it from.
+static const uint8_t PULSE_PIN = Board::PULSE_PIN;
+static const uint8_t ARMED_PIN = Board::ARMED_PIN;
+static const uint8_t CLAMP_PIN = Board::CLAMP_PIN;
+
+static const double WATT_US_PER_PULSE = 0.5 * 3600000.0 * 1000.0;
+static const uint64_t PULSE_WIDTH = 30000; // S0 outputs hold each pulse for at least 30ms.
+static const uint64_t HORIZON = 2000000;   // Pulses are scheduled this far ahead; loop() can sleep for up to a second.
+static const double CLAMP_COUNTS_PER_AMP = 1000.0 / 146; // An SCT-013-030 on the 5V reference, as in CurrentSensor.h.
+
+// The clamp's output for the load, a 50Hz sine on a mid-rail bias, as
+// the ADC would read it.
+static int clampReading(uint8_t, uint64_t atMicros, void *context)
+{
+  double amps = *(double *)context / 230;
+  double counts = 512 + amps * CLAMP_COUNTS_PER_AMP * M_SQRT2 * sin(2 * M_PI * 50 * atMicros / 1e6);
+  return counts < 0 ? 0 : counts > 1023 ? 1023 : (int)lround(counts);
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 60;
+  double watts = 0;
+  uint64_t step = 100;
+  uint64_t cost = 200;
+  uint64_t origin = 0;
+  bool armed = true;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:w:s:c:W:mq")) != -1) {
+    switch (opt) {
+      case 't': seconds = atof(optarg); break;
+      case 'w': watts = atof(optarg); break;
+      case 's': step = strtoull(optarg, NULL, 10); break;
+      case 'c': cost = strtoull(optarg, NULL, 10); break;
+      case 'W': origin = (1ULL << 32) * 1000 - (uint64_t)(atof(optarg) * 1000000.0); break;
+      case 'm': armed = false; break;
+      case 'q': HostSerial::setSink(NULL, NULL); break;
+      default:
+        fprintf(stderr, "usage: %s [-t seconds] [-w watts] [-s step_us] [-c us_per_pass] [-W seconds] [-m] [-q]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (step == 0) step = 1;
+
+  HostClock::reset(origin);
+
+  // The arm switch pulls its input low when armed.
+  HostPins::set(ARMED_PIN, armed ? LOW : HIGH);
+  HostPins::set(PULSE_PIN, HIGH);
+  HostPins::analogSource(CLAMP_PIN, clampReading, &watts);
+
+  setup();
+
+  uint64_t end = origin + (uint64_t)(seconds * 1000000.0);
+  uint64_t interval = watts > 0 ? (uint64_t)(WATT_US_PER_PULSE / watts) : 0;
+  uint64_t nextPulse = origin + interval;
+  uint64_t loops = 0;
+
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  while (HostClock::now() < end) {
+    while (interval && nextPulse <= HostClock::now() + HORIZON) {
+      HostPins::schedule(nextPulse, PULSE_PIN, LOW);
+      HostPins::schedule(nextPulse + PULSE_WIDTH, PULSE_PIN, HIGH);
+      nextPulse += interval;
+    }
+    uint64_t before = HostClock::now();
+    loop();
+    loops++;
+    HostClock::advance(cost);
+    if (HostClock::now() == before) {
+      HostClock::advance(step);
+    }
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  fprintf(stderr, "%.0f simulated seconds, %llu loops (%.1f/s), %.1f%% asleep, %.1fms blocked on serial, %.3fs wall, %.0fx real time\n",
+          seconds, (unsigned long long)loops, seconds > 0 ? loops / seconds : 0.0,
+          100.0 * HostSleep::slept() / (HostClock::now() - origin),
+          HostSerial::blocked() / 1000.0, wall, wall > 0 ? seconds / wall : 0.0);
+  return 0;
+}
@@ -0,0 +1,547 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+// Sweeps the detection settings over labelled pulse traces, and prints
+// the settings that no other setting beats on every count:
+//
+//   missed     tool runs the vacuum never came on for
+//   on.mean    mean wait from the tool switching on to the relay
+//   false      relay switch-ons with no tool running
+//   cycles/h   relay switch-ons per simulated hour
+//
+// Each setting is replayed over each trace through the firmware's own
+// Channel, PowerMeter, Calibration and state machine. The firmware's
+// globals are thread local on the host, as is the HAL, so every
+// simulation runs on its own, on a pool of threads that steal work from
+// each other once their own share is done.
+//
+// The settings, with -s name=from:to:step or name=a,b,c (the firmware's
+// own when not given; with no -s at all, start, vacuum and cooldown are
+// swept over a default grid):
+//
+//   start      W the tool has to add before the vacuum starts
+//   vacuum     W the vacuum adds; the "tool plus vacuum" level is this
+//              above the start
+//   cooldown   ms, see Channel::cooldown()
+//   drift      the CUSUM estimator's, see ChangeDetector
+//   threshold
+//   estimator  average, interval or change
+//
+// start and vacuum are given to Calibration as learned levels, so it
+// goes on learning from them as it would on the board. -r draws that
+// many settings at random from the grid instead of running all of it.
+//
+// The meter's stats period and windows, AVG_FREQ, AVG_WINDOW and
+// WATT_WINDOW, size its buffers, so they are build flags rather than
+// settings: build once with each, say -DAVG_WINDOW=3000, to compare them.
+//
+// As in the bench, the vacuum's own draw (-V, 1500W by default) is added
+// to the meter while the relay is on.
+//
+//   autovac_tune [-s name=values ...] [-r samples] [-S seed] [-p profile,...]
+//                [-n seeds] [-H hours] [-V watts] [-j threads] [-a] [traces...]
+
+#include <ArduinoHost.h>
+#include <PulseTrace.h>
+#include "Channel.h"
+#include "Debouncer.h"
+#include "EventLog.h"
+#include "Settings.h"
+#include "Timers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  const uint8_t PULSE_PIN = Board::PULSE_PIN;
+  const uint8_t RELAY_PIN = Board::RELAY_PIN;
+
+  const uint64_t SECOND = 1000000;
+  const uint64_t PULSE_WIDTH = 30000;      // As in the bench.
+  const uint64_t TAIL = 30 * SECOND;
+  const uint64_t LATE_GRACE = 10 * SECOND;
+  const uint64_t PULSE_GAP = 5000;
+  const uint64_t LONGEST_STEP = SECOND;    // The meter's stats timer wakes the loop far more often.
+  const double WH_PER_PULSE = 0.5;
+
+  enum Param {
+    PARAM_START,
+    PARAM_VACUUM,
+    PARAM_COOLDOWN,
+    PARAM_DRIFT,
+    PARAM_THRESHOLD,
+    PARAM_ESTIMATOR,
+    PARAM_COUNT
+  };
+
+  const char *const PARAM_NAMES[PARAM_COUNT] = { "start", "vacuum", "cooldown", "drift", "threshold", "estimator" };
+  const char *const ESTIMATOR_NAMES[] = { "average", "interval", "change" };
+  const long ESTIMATORS = sizeof(ESTIMATOR_NAMES) / sizeof(ESTIMATOR_NAMES[0]);
+
+  struct Setting
+  {
+    long value[PARAM_COUNT];
+  };
+
+  // One simulation's counts.
+  struct Outcome
+  {
+    RelayScore score;
+    double hours;
+  };
+
+  // A setting's counts over every trace.
+  struct Summary
+  {
+    Setting setting;
+    unsigned toolRuns;
+    unsigned missed;
+    unsigned falseStarts;
+    double onMean;
+    double onMedian;
+    double onP95;
+    double offMedian;
+    double cyclesPerHour;
+    bool front;
+  };
+
+  struct Options
+  {
+    double vacuum;
+  };
+
+  typedef std::vector<std::pair<uint64_t, bool> > RelayLog;
+
+  void relayWritten(uint8_t pin, uint8_t level, void *context)
+  {
+    RelayLog *log = (RelayLog *)context;
+    bool on = level == LOW; // The relay is active low.
+    if (pin != RELAY_PIN || on == (!log->empty() && log->back().second)) return;
+    log->push_back(std::make_pair(HostClock::now(), on));
+  }
+
+  // Runs one channel over the trace with the setting, the way loop()
+  // does, sleeping until the next timer or pin change in between.
+  Outcome simulate(const Trace &trace, const Setting &setting, const Options &options)
+  {
+    hostReset();
+    HostSerial::setSink(NULL, NULL);
+    RelayLog relay;
+    HostPins::onWrite(relayWritten, &relay);
+    HostPins::set(PULSE_PIN, HIGH);
+
+    Settings levels;
+    levels.learned = Calibration::LEARNED_VACUUM | Calibration::LEARNED_TOOL;
+    levels.baselineWatts = 0;
+    levels.vacuumWatts = setting.value[PARAM_VACUUM];
+    levels.toolWatts = 2 * setting.value[PARAM_START]; // The start threshold is halfway up the tool.
+    saveSettings(levels, 0);
+
+    timers.tick();
+    ChannelConfig config;
+    config.meterPin = PULSE_PIN;
+    config.overridePin = NO_PIN;
+    config.extractor = 0;
+    config.estimator = (PowerMeter::Estimator)setting.value[PARAM_ESTIMATOR];
+    config.clamp = NULL;
+    config.powerLed = NULL;
+    config.overrideLed = NULL;
+    Extractor extractor;
+    extractor.attach(RELAY_PIN);
+    Channel channel;
+    channel.cooldown(setting.value[PARAM_COOLDOWN]);
+    channel.begin(0, config, extractor, true);
+    channel.meter().detector().tune(setting.value[PARAM_DRIFT], setting.value[PARAM_THRESHOLD]);
+
+    std::vector<std::pair<uint64_t, uint64_t> > edges = pulseEdges(trace, PULSE_WIDTH);
+    for (size_t i = 0; i < edges.size(); i++) {
+      HostPins::schedule(edges[i].first, PULSE_PIN, LOW);
+      HostPins::schedule(edges[i].second, PULSE_PIN, HIGH);
+    }
+    std::vector<uint64_t> pulses = pulseTimes(trace);
+    double vacuumWh = 0;
+
+    uint64_t end = trace.duration() + TAIL;
+    while (HostClock::now() < end) {
+      uint32_t now = timers.tick();
+      timers.run();
+      inputs.update(now);
+      channel.updateMeter();
+      channel.updateState(now);
+      eventLog.drain();
+      if (channel.pending()) continue;
+
+      uint64_t before = HostClock::now();
+      uint64_t wake = before + LONGEST_STEP;
+      uint32_t deadline;
+      uint64_t event;
+      if (timers.nextDeadline(deadline)) wake = std::min(wake, (uint64_t)deadline * 1000);
+      if (HostClock::nextEvent(event)) wake = std::min(wake, event);
+      HostClock::advanceTo(std::max(wake, before + 1));
+
+      if (!relay.empty() && relay.back().second) {
+        vacuumWh += options.vacuum * (HostClock::now() - before) / 3600e6;
+        if (vacuumWh >= WH_PER_PULSE) {
+          vacuumWh -= WH_PER_PULSE;
+          uint64_t at = clearOfPulses(pulses, HostClock::now() + 1000, PULSE_WIDTH, PULSE_GAP);
+          HostPins::schedule(at, PULSE_PIN, LOW);
+          HostPins::schedule(at + PULSE_WIDTH, PULSE_PIN, HIGH);
+        }
+      }
+    }
+
+    Outcome outcome;
+    outcome.score = scoreRelay(trace, relay, LATE_GRACE);
+    outcome.hours = end / 3600e6;
+    return outcome;
+  }
+
+  // A thread's share of the tasks. It takes from the back of its own, and
+  // other threads steal from the front.
+  struct TaskQueue
+  {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+
+    bool take(size_t &task, bool own)
+    {
+      std::lock_guard<std::mutex> hold(lock);
+      if (tasks.empty()) return false;
+      if (own) {
+        task = tasks.back();
+        tasks.pop_back();
+      } else {
+        task = tasks.front();
+        tasks.pop_front();
+      }
+      return true;
+    }
+  };
+
+  // Runs work(0) to work(count - 1) on `threads` threads. Each starts with
+  // a block of its own and then steals from the others, so that a few
+  // slow simulations, say a setting that keeps the relay cycling, don't
+  // leave the rest of the threads waiting.
+  void runStealing(size_t count, int threads, const std::function<void(size_t)> &work)
+  {
+    std::vector<TaskQueue> queues(threads);
+    for (size_t t = 0; t < count; t++) {
+      queues[t * threads / count].tasks.push_back(t);
+    }
+
+    std::atomic<size_t> left(count);
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++) {
+      pool.push_back(std::thread([&, i]() {
+        while (left.load() > 0) {
+          size_t task;
+          bool found = queues[i].take(task, true);
+          for (int k = 1; k < threads && !found; k++) {
+            found = queues[(i + k) % threads].take(task, false);
+          }
+          if (!found) {
+            std::this_thread::yield();
+            continue;
+          }
+          work(task);
+          left--;
+        }
+      }));
+    }
+    for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+  }
+
+  double percentile(const std::vector<double> &sorted, unsigned percent)
+  {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() * percent / 100, sorted.size() - 1)];
+  }
+
+  Summary summarise(const Setting &setting, const Outcome *outcomes, size_t count)
+  {
+    Summary s;
+    memset(&s, 0, sizeof(s));
+    s.setting = setting;
+    std::vector<double> on, off;
+    unsigned relayOns = 0;
+    double hours = 0;
+    for (size_t i = 0; i < count; i++) {
+      const RelayScore &score = outcomes[i].score;
+      s.toolRuns += score.toolRuns;
+      s.missed += score.missed;
+      s.falseStarts += score.falseStarts;
+      relayOns += score.relayOns;
+      hours += outcomes[i].hours;
+      on.insert(on.end(), score.onLatency.begin(), score.onLatency.end());
+      off.insert(off.end(), score.offLatency.begin(), score.offLatency.end());
+    }
+    std::sort(on.begin(), on.end());
+    std::sort(off.begin(), off.end());
+    for (size_t i = 0; i < on.size(); i++) s.onMean += on[i] / on.size();
+    s.onMedian = percentile(on, 50);
+    s.onP95 = percentile(on, 95);
+    s.offMedian = percentile(off, 50);
+    s.cyclesPerHour = hours > 0 ? relayOns / hours : 0;
+    return s;
+  }
+
+  // No worse on any count, and better on at least one. Missed runs are
+  // counted too: a setting that never starts for short runs would
+  // otherwise look quick.
+  bool dominates(const Summary &a, const Summary &b)
+  {
+    double ak[] = { (double)a.missed, a.onMean, (double)a.falseStarts, a.cyclesPerHour };
+    double bk[] = { (double)b.missed, b.onMean, (double)b.falseStarts, b.cyclesPerHour };
+    bool better = false;
+    for (int i = 0; i < 4; i++) {
+      if (ak[i] > bk[i]) return false;
+      better = better || ak[i] < bk[i];
+    }
+    return better;
+  }
+
+  void markFront(std::vector<Summary> &summaries)
+  {
+    for (size_t i = 0; i < summaries.size(); i++) {
+      summaries[i].front = true;
+      for (size_t j = 0; j < summaries.size() && summaries[i].front; j++) {
+        summaries[i].front = !dominates(summaries[j], summaries[i]);
+      }
+    }
+  }
+
+  bool byMissedThenLatency(const Summary &a, const Summary &b)
+  {
+    if (a.missed != b.missed) return a.missed < b.missed;
+    if (a.onMean != b.onMean) return a.onMean < b.onMean;
+    return a.falseStarts < b.falseStarts;
+  }
+
+  void report(const std::vector<Summary> &summaries, bool all)
+  {
+    printf("  %6s %6s %8s %5s %9s %9s | %6s %7s %7s %7s %6s %8s %7s\n",
+           "start", "vacuum", "cooldown", "drift", "threshold", "estimator",
+           "missed", "on.mean", "on.med", "on.p95", "false", "cycles/h", "off.med");
+    for (size_t i = 0; i < summaries.size(); i++) {
+      const Summary &s = summaries[i];
+      if (!all && !s.front) continue;
+      const long *v = s.setting.value;
+      printf("%c %6ld %6ld %8ld %5ld %9ld %9s | %6u %6.2fs %6.2fs %6.2fs %6u %8.1f %6.2fs\n",
+             s.front ? '*' : ' ', v[PARAM_START], v[PARAM_VACUUM], v[PARAM_COOLDOWN], v[PARAM_DRIFT],
+             v[PARAM_THRESHOLD], ESTIMATOR_NAMES[v[PARAM_ESTIMATOR]],
+             s.missed, s.onMean, s.onMedian, s.onP95, s.falseStarts, s.cyclesPerHour, s.offMedian);
+    }
+  }
+
+  bool parseValue(Param param, const std::string &text, long &value)
+  {
+    if (param == PARAM_ESTIMATOR) {
+      for (long e = 0; e < ESTIMATORS; e++) {
+        if (text == ESTIMATOR_NAMES[e]) {
+          value = e;
+          return true;
+        }
+      }
+      return false;
+    }
+    char *end;
+    value = strtol(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && value >= 0 && value <= 30000;
+  }
+
+  // name=from:to:step or name=a,b,c, into the list of values to try.
+  bool parseParam(const char *arg, std::vector<long> values[PARAM_COUNT])
+  {
+    const char *equals = strchr(arg, '=');
+    if (equals == NULL) return false;
+    std::string name(arg, equals - arg), spec(equals + 1);
+    int param = 0;
+    while (param < PARAM_COUNT && name != PARAM_NAMES[param]) param++;
+    if (param == PARAM_COUNT) return false;
+
+    std::vector<long> &list = values[param];
+    list.clear();
+    long from, to, step;
+    if (param != PARAM_ESTIMATOR && sscanf(spec.c_str(), "%ld:%ld:%ld", &from, &to, &step) == 3) {
+      if (step <= 0 || from < 0 || to < from || to > 30000) return false;
+      for (long v = from; v <= to; v += step) list.push_back(v);
+      return true;
+    }
+    size_t start = 0, comma;
+    do {
+      comma = spec.find(',', start);
+      long value;
+      if (!parseValue((Param)param, spec.substr(start, comma - start), value)) return false;
+      list.push_back(value);
+      start = comma + 1;
+    } while (comma != std::string::npos);
+    return true;
+  }
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr,
+            "usage: %s [-s name=from:to:step|name=a,b,c ...] [-r samples] [-S seed] [-p profile,...]\n"
+            "          [-n seeds] [-H hours] [-V watts] [-j threads] [-a] [traces...]\n"
+            "settings: start vacuum cooldown drift threshold estimator\n", argv0);
+    exit(2);
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  std::vector<long> values[PARAM_COUNT];
+  values[PARAM_START].push_back(DEFAULT_TOOL_WATTS / 2);
+  values[PARAM_VACUUM].push_back(DEFAULT_VACUUM_WATTS);
+  values[PARAM_COOLDOWN].push_back(COOLDOWN);
+  values[PARAM_DRIFT].push_back(CHANGE_DRIFT);
+  values[PARAM_THRESHOLD].push_back(CHANGE_THRESHOLD);
+  values[PARAM_ESTIMATOR].push_back(PowerMeter::ESTIMATE_AVERAGE);
+  bool swept = false;
+
+  std::vector<std::string> profiles;
+  int seeds = 1;
+  uint32_t seed = 1;
+  double hours = 1;
+  int samples = 0;
+  bool all = false;
+  int threads = (int)std::thread::hardware_concurrency();
+  Options options;
+  options.vacuum = 1500;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:S:p:n:H:V:j:a")) != -1) {
+    switch (opt) {
+      case 's':
+        if (!parseParam(optarg, values)) {
+          fprintf(stderr, "bad setting '%s'\n", optarg);
+          usage(argv[0]);
+        }
+        swept = true;
+        break;
+      case 'p': {
+        std::string list = optarg;
+        size_t start = 0, comma;
+        while ((comma = list.find(',', start)) != std::string::npos) {
+          profiles.push_back(list.substr(start, comma - start));
+          start = comma + 1;
+        }
+        profiles.push_back(list.substr(start));
+        break;
+      }
+      case 'r': samples = atoi(optarg); break;
+      case 'S': seed = strtoul(optarg, NULL, 10); break;
+      case 'n': seeds = atoi(optarg); break;
+      case 'H': hours = atof(optarg); break;
+      case 'V': options.vacuum = atof(optarg); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'a': all = true; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (threads < 1) threads = 1;
+  if (!swept) {
+    parseParam("start=300:900:100", values);
+    parseParam("vacuum=1000:2000:250", values);
+    parseParam("cooldown=2000:8000:2000", values);
+  }
+
+  std::vector<Trace> traces;
+  for (int i = optind; i < argc; i++) {
+    Trace trace;
+    if (!loadTrace(argv[i], trace)) {
+      fprintf(stderr, "can't read %s\n", argv[i]);
+      return 1;
+    }
+    traces.push_back(trace);
+  }
+  if (traces.empty() && profiles.empty()) profiles = traceProfiles();
+  for (size_t p = 0; p < profiles.size(); p++) {
+    for (int s = 0; s < seeds; s++) {
+      Trace trace;
+      if (!generateTrace(profiles[p], seed + s, hours, trace)) {
+        fprintf(stderr, "unknown profile '%s'\n", profiles[p].c_str());
+        return 2;
+      }
+      traces.push_back(trace);
+    }
+  }
+
+  // The whole grid, or samples drawn from it.
+  std::vector<Setting> settings;
+  if (samples > 0) {
+    std::mt19937 rng(seed);
+    for (int i = 0; i < samples; i++) {
+      Setting s;
+      for (int p = 0; p < PARAM_COUNT; p++) {
+        s.value[p] = values[p][std::uniform_int_distribution<size_t>(0, values[p].size() - 1)(rng)];
+      }
+      settings.push_back(s);
+    }
+  } else {
+    Setting s;
+    size_t index[PARAM_COUNT] = { 0 };
+    while (true) {
+      for (int p = 0; p < PARAM_COUNT; p++) s.value[p] = values[p][index[p]];
+      settings.push_back(s);
+      int p = 0;
+      while (p < PARAM_COUNT && ++index[p] == values[p].size()) index[p++] = 0;
+      if (p == PARAM_COUNT) break;
+    }
+  }
+
+  size_t tasks = settings.size() * traces.size();
+  std::vector<Outcome> outcomes(tasks);
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  runStealing(tasks, threads, [&](size_t task) {
+    outcomes[task] = simulate(traces[task % traces.size()], settings[task / traces.size()], options);
+  });
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  std::vector<Summary> summaries;
+  for (size_t i = 0; i < settings.size(); i++) {
+    summaries.push_back(summarise(settings[i], &outcomes[i * traces.size()], traces.size()));
+  }
+  markFront(summaries);
+  std::sort(summaries.begin(), summaries.end(), byMissedThenLatency);
+
+  size_t front = 0;
+  for (size_t i = 0; i < summaries.size(); i++) front += summaries[i].front;
+  printf("%zu settings over %zu traces, %u tool runs: %zu simulations in %.1fs on %d threads, %.0f/s\n",
+         settings.size(), traces.size(), summaries.empty() ? 0 : summaries[0].toolRuns, tasks, wall, threads,
+         wall > 0 ? tasks / wall : 0);
+  printf("meter built with AVG_FREQ %dms, AVG_WINDOW %dms, WATT_WINDOW %dms\n",
+         (int)AVG_FREQ, (int)AVG_WINDOW, (int)WATT_WINDOW);
+  printf("pareto front: %zu of %zu settings (*)\n\n", front, settings.size());
+  report(summaries, all);
+  return 0;
+}
@@ -18,364 +18,315 @@
 
 // Requires the following libraries from the library manager:
 // Adafruit NeoPixel
-// Bounce2
 #include <Arduino.h>
 #include <Adafruit_NeoPixel.h>
-#include <Bounce2.h>
 #include <HardwareSerial.h>
 
+#include "Board.h"
+#include "Channel.h"
+#include "CurrentSensor.h"
+#include "Debouncer.h"
+#include "EventLog.h"
 #include "Led.h"
-#include "PowerMeter.h"
+#include "Ledger.h"
+#include "LedStrip.h"
+#include "LoopTiming.h"
+#include "PowerArchive.h"
+#include "Snapshot.h"
+#include "Telemetry.h"
+#include "Tickless.h"
+#include "Timers.h"
 
 // #define DEBUG_STATUS 1
 
-typedef enum {
-	STATE_MANUAL_IDLE = 0,
-	STATE_MANUAL_RUNNING,
-	STATE_AUTO_IDLE,
-	STATE_AUTO_RUNNING,
-	STATE_AUTO_FORCED_RUNNING,
-	STATE_AUTO_FORCED_STOPPED,
-	STATE_AUTO_COOLING_DOWN
-} State_type;
-
-extern State_type instate_ManualIdle();
-extern State_type instate_ManualRunning();
-extern State_type instate_AutoIdle();
-extern State_type instate_AutoRunning();
-extern State_type instate_AutoForcedRunning();
-extern State_type instate_AutoForcedStopped();
-extern State_type instate_AutoCoolingDown();
-void vacuum_turn_on();
-void vacuum_turn_off();
-
-State_type (*state_table[])() = {
-	instate_ManualIdle,
-	instate_ManualRunning,
-	instate_AutoIdle,
-	instate_AutoRunning,
-	instate_AutoForcedRunning,
-	instate_AutoForcedStopped,
-	instate_AutoCoolingDown
-};
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 9600 // Or build with -DSERIAL_BAUD=115200, say, for TELEMETRY.
+#endif
 
-State_type _currentState;
-bool stateEnterRan = false;
+bool SystemIsArmed();
+void ReportStatus(void *);
+void SnapshotOnChange(uint32_t now);
+void SaveSnapshot(void *);
+void Sleep();
+void Command(int c);
 
-const float WH_PER_PULSE = 0.5; // The meter pulses 2,000 per kWh (0.5Wh/imp).
-const long MS_PER_HOUR = 3600000;
-const int VAC_WATTS = 1500; // Vacuum Power. Ideally we'll learn this from some sort of calibration eventually.
-const int MIN_WATTS = 500; // The minimum trigger value. Ideally we'll learn this from some sort of calibration eventually.
-const int UPDATE_INTERVAL = 500; // How many millis between updates.
-const long COOLDOWN = 5000; // How many millis after an OFF before the vac can come on again
+const bool TICKLESS_LOOP = true; // Sleep between deadlines instead of spinning loop().
+const int LOG_DRAIN_INTERVAL = SERIAL_BAUD > 100000L ? 1 : 100000L / SERIAL_BAUD; // ms between log sends while records are waiting; about 10 bytes' time.
 
-const int PULSE_PIN = 2; // ISR Pin connected to the power meter.
-const int OVERRIDE_PIN = 4; // Input Pin connected to the override button.
-const int RELAY_PIN = 7; // Output Pin connected to the main control relay
-const int ARMED_PIN = 8; // Input Pin connected to the master on/off toggle switch
-const int LED_PIN = 3; // NeoPixel Data Pin
+// Pins, from the board's profile in Board.h.
+const int PULSE_PIN = Board::PULSE_PIN; // ISR Pin connected to the power meter.
+const int OVERRIDE_PIN = Board::OVERRIDE_PIN; // Input Pin connected to the override button.
+const int RELAY_PIN = Board::RELAY_PIN; // Output Pin connected to the main control relay
+const int ARMED_PIN = Board::ARMED_PIN; // Input Pin connected to the master on/off toggle switch
+const int LED_PIN = Board::LED_PIN; // NeoPixel Data Pin
+const int CLAMP_PIN = Board::CLAMP_PIN; // Analog Pin connected to the CT clamp, if there is one
 
 const int POWER_LED = 0;
 const int OVERRIDE_LED = 1;
 
-// Power LED Colours
-const uint32_t POWERLED_OFF[]      = { 0, 0, 0 };
-const uint32_t POWERLED_ARMED[]    = { 0, 100, 0 };
-const uint32_t POWERLED_DISARMED[] = { 0, 0, 0 };
-const uint32_t POWERLED_RUNNING[]  = { 128, 0, 0 };
-const uint32_t POWERLED_PULSE[]    = { 255, 255, 0 };
-
-// Button LED Colours
-const uint32_t BUTTONLED_OFF[]        = { 0, 0, 0 }; // Off
-const uint32_t BUTTONLED_AUTO[]       = { 0, 0, 0 }; // Green
-const uint32_t BUTTONLED_FORCED_OFF[] = { 255, 100, 0 }; // Orange
-const uint32_t BUTTONLED_FORCED_ON[]  = { 255, 0, 0 }; // Red
-
-Bounce overrideButton = Bounce();
-Bounce powerToggle = Bounce();
+const uint32_t LED_OFF[] = { 0, 0, 0 };
+
+int8_t powerToggle = -1; // The armed switch's input in the debouncer.
 Adafruit_NeoPixel strip = Adafruit_NeoPixel(2, LED_PIN, NEO_GRB + NEO_KHZ800);
 
-Led powerled = Led(strip, 0);
-Led overrideled = Led(strip, 1);
-PowerMeter meter = PowerMeter();
+LedStrip leds = LedStrip(strip);
+Led powerled = Led(leds, POWER_LED);
+Led overrideled = Led(leds, OVERRIDE_LED);
+CurrentSensor clamp = CurrentSensor(CLAMP_PIN);
+
+// Relay pins of the dust extractors, and the tool circuits that use
+// them. More tools can share an extractor by naming the same index;
+// each channel needs a meter pin of its own, on an interrupt pin if it
+// can have one. One channel can also have the clamp, and use it with
+// ESTIMATE_CURRENT.
+const int EXTRACTOR_PINS[] = { RELAY_PIN };
+constexpr ChannelConfig CHANNELS[] = {
+	// meter      override      extractor  estimator (see PowerMeter::Estimator)                         clamp  LEDs
+	{ PULSE_PIN,  OVERRIDE_PIN, 0,         PowerMeter::ESTIMATE_AVERAGE,                                NULL,  &powerled, &overrideled },
+};
 
+const uint8_t EXTRACTOR_COUNT = sizeof(EXTRACTOR_PINS) / sizeof(EXTRACTOR_PINS[0]);
+const uint8_t CHANNEL_COUNT = sizeof(CHANNELS) / sizeof(CHANNELS[0]);
+static_assert(CHANNEL_COUNT <= CHANNEL_MAX, "Too many channels");
+static_assert(CHANNEL_COUNT <= Board::CHANNEL_LIMIT, "Too many channels for this board's profile");
+static_assert(ARCHIVE_CHANNEL < CHANNEL_COUNT, "The power archive keeps one of the channels");
 
-void setup() {
-	// Set up the power toggle input
-	pinMode(ARMED_PIN, INPUT_PULLUP);
-	powerToggle.attach(ARMED_PIN);
-	powerToggle.interval(25);
+constexpr bool extractorsValid(uint8_t channel = 0)
+{
+	return channel >= CHANNEL_COUNT || (CHANNELS[channel].extractor < EXTRACTOR_COUNT && extractorsValid(channel + 1));
+}
 
-	// Set up the override button
-	pinMode(OVERRIDE_PIN, INPUT_PULLUP);
-	overrideButton.attach(OVERRIDE_PIN);
-	overrideButton.interval(25);
+static_assert(extractorsValid(), "Each channel's extractor must be one of EXTRACTOR_PINS");
 
-	// Set up the power meter input
-	meter.attach(PULSE_PIN);
+Extractor extractors[EXTRACTOR_COUNT];
+Channel channels[CHANNEL_COUNT];
+Tickless tickless = Tickless();
+Timer statusTimer = Timer(ReportStatus);
+Timer drainTimer = Timer(); // Wakes the loop to send more of the log.
+Timer snapshotTimer = Timer(SaveSnapshot);
+State_type snapshotStates[CHANNEL_COUNT]; // The states in the last snapshot taken.
+uint64_t snapshotPulses = 0;              // And the meter pulses in it, over all channels.
+uint32_t lastSnapshot = 0;
 
-	// Set up the LED output
-	strip.begin();
-	strip.setBrightness(64);
-	powerled.set(POWERLED_OFF);
-	overrideled.set(BUTTONLED_OFF);
-	strip.show();
+// The firmware's globals, and the core's serial port, have to leave the
+// board the RAM its profile keeps back for the stack and the heap.
+constexpr size_t GLOBALS_RAM = sizeof(Serial) + sizeof(strip) + sizeof(leds) + sizeof(powerled) + sizeof(overrideled)
+	+ sizeof(clamp) + sizeof(extractors) + sizeof(channels) + sizeof(tickless) + sizeof(statusTimer) + sizeof(drainTimer)
+	+ sizeof(snapshotTimer) + sizeof(snapshotStates) + sizeof(snapshotPulses) + sizeof(lastSnapshot)
+	+ sizeof(timers) + sizeof(inputs) + sizeof(eventLog) + sizeof(ledger)
+	+ LOOP_TIMING_RAM + TELEMETRY_RAM + ARCHIVE_RAM;
+static_assert(GLOBALS_RAM + Board::RESERVED_RAM <= Board::SRAM, "The globals leave too little of this board's SRAM");
 
-	// Set up the relay output
-	pinMode(RELAY_PIN, OUTPUT);
-	digitalWrite(RELAY_PIN, HIGH);
 
-	// Set up the rest
-	Serial.begin(9600);
-	vacuum_turn_off();
-	Serial.println("Started.");
-}
+void setup() {
+	timers.tick();
 
+	// Set up the power toggle input
+	pinMode(ARMED_PIN, INPUT_PULLUP);
+	powerToggle = inputs.attach(ARMED_PIN);
+	tickless.watch(ARMED_PIN);
 
-unsigned long timeSinceStatus = millis();
+	// Set up the LED output
+	powerled.set(LED_OFF);
+	overrideled.set(LED_OFF);
+	leds.begin(64);
 
-bool SystemIsArmed() {
-	return !powerToggle.read();
-}
+	// Set up the relay outputs
+	for (uint8_t i = 0; i < EXTRACTOR_COUNT; i++) {
+		extractors[i].attach(EXTRACTOR_PINS[i]);
+	}
 
-void loop() {
-	powerToggle.update();
-	overrideButton.update();
-	powerled.update();
-	meter.update();
-
-	// Show a blip if a pulse was detected
-	if (meter.pulseSeen()) {
-		// Serial.print(_currentState); Serial.print(" Pulse "); Serial.print(meter.averageW()); Serial.print("W "); Serial.print(meter.totalWh()); Serial.println("Wh");
-		powerled.pulse(strip.Color(0, 0, 50), 50);
+	// Set up the rest
+	Serial.begin(SERIAL_BAUD);
+	eventLog.write(LOG_STARTED);
+	ledger.begin();
+
+	// Start each channel, with its meter, override button and learned
+	// thresholds, carrying on from the last snapshot if it was taken with
+	// the same channels.
+	Snapshot snapshot;
+	bool warm = loadSnapshot(snapshot) && snapshot.channels == CHANNEL_COUNT;
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		channels[i].begin(i, CHANNELS[i], extractors[CHANNELS[i].extractor], SystemIsArmed(),
+		                  warm ? &snapshot.channel[i] : NULL);
+		if (CHANNELS[i].overridePin != NO_PIN) {
+			tickless.watch(CHANNELS[i].overridePin);
+		}
+		if (channels[i].meter().polled()) {
+			tickless.watch(CHANNELS[i].meterPin);
+		}
+		snapshotStates[i] = channels[i].state();
+		snapshotPulses += channels[i].meter().pulses();
 	}
+	lastSnapshot = timers.now();
+	timers.start(snapshotTimer, SNAPSHOT_PERIOD);
+	TELEMETRY_BEGIN(channels, CHANNEL_COUNT);
+	ARCHIVE_BEGIN(channels[ARCHIVE_CHANNEL].meter());
 
 #ifdef DEBUG_STATUS
-	if(millis() -  timeSinceStatus > 1000) {
-		Serial.print(millis());
-		Serial.print(" STATUS\t"); Serial.print(_currentState);
-		Serial.print(" ARM:"); Serial.print(SystemIsArmed());
-		Serial.print(" W:"); Serial.print(meter.averageW());
-		Serial.print(" Wh:"); Serial.print(meter.totalWh());
-		Serial.println();
-		timeSinceStatus = millis();
-	}
+	timers.start(statusTimer, 1000, 1000);
 #endif
-
-	_currentState = state_table[_currentState]();
-
-	strip.show();
 }
 
 
-State_type changeState(State_type newState) {
-	if (newState != _currentState) {
-		stateEnterRan = false;
-	}
-	_currentState = newState;
-	return newState;
+bool SystemIsArmed() {
+	return !inputs.read(powerToggle);
 }
 
 
-State_type instate_ManualIdle() {
-	if (!stateEnterRan) {
-		Serial.println("Now Manual Idle.");
-		vacuum_turn_off();
-		powerled.set(POWERLED_DISARMED);
-		stateEnterRan = true;
-	}
-
-	if (SystemIsArmed()) {
-		Serial.println("System now armed, switching to Auto Idle.");
-		return changeState(STATE_AUTO_IDLE);
-	}
-
-	bool overridePressed = overrideButton.fell();
-	if (overridePressed) {
-		Serial.println("Override pressed, switching to Manual Running.");
-		return changeState(STATE_MANUAL_RUNNING);
+bool WorkIsPending() {
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		if (channels[i].pending()) {
+			return true;
+		}
 	}
-
-	return STATE_MANUAL_IDLE;
+	return Serial.available() > 0;
 }
 
 
-State_type instate_ManualRunning() {
-	if (!stateEnterRan) {
-		Serial.println("Now Manual Running.");
-		vacuum_turn_on();
-		powerled.set(POWERLED_RUNNING);
-		stateEnterRan = true;
-	}
-
-	// bool systemArmed = !powerToggle.read();
-	if (SystemIsArmed()) {
-		Serial.println("No armed, switching to Auto Idle.");
-		return changeState(STATE_AUTO_IDLE);
-	}
-
-	bool overridePressed = overrideButton.fell();
-	if (overridePressed) {
-		Serial.println("Override pressed, switching to Manual Idle.");
-		return changeState(STATE_MANUAL_IDLE);
-	}
 
-	return changeState(STATE_MANUAL_RUNNING);
-}
+void loop() {
+	uint32_t now;
 
+	LOOP_TIMING_START();
+	now = timers.tick();
+	timers.run();
+	inputs.update(now);
+	LOOP_TIMING_MARK(STAGE_INPUTS);
 
-State_type instate_AutoIdle() {
-	if (!stateEnterRan) {
-		Serial.println("Now Idle.");
-		vacuum_turn_off();
-		powerled.set(POWERLED_ARMED);
-		overrideled.set(BUTTONLED_AUTO);
-		stateEnterRan = true;
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		channels[i].updateMeter();
 	}
+	LOOP_TIMING_MARK(STAGE_METER);
 
-	// bool systemArmed = !powerToggle.read();
-	if (!SystemIsArmed()) {
-		Serial.println("No longer armed, switching to Manual Idle.");
-		return changeState(STATE_MANUAL_IDLE);
-	}
-
-	bool overridePressed = overrideButton.fell();
-	if (overridePressed) {
-		Serial.println("Override pressed, switching to Auto Forced Running.");
-		return changeState(STATE_AUTO_FORCED_RUNNING);
+	// The armed switch is shared by every channel.
+	if (inputs.fell(powerToggle) || inputs.rose(powerToggle)) {
+		for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+			channels[i].armed(inputs.fell(powerToggle));
+		}
 	}
-
-	if (meter.averageW() > MIN_WATTS) {
-		Serial.println("W above threshold, switching to Auto Running.");
-		return changeState(STATE_AUTO_RUNNING);
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		channels[i].updateState(now);
 	}
+	SnapshotOnChange(now);
+	LOOP_TIMING_MARK(STAGE_STATE);
 
-	return changeState(STATE_AUTO_IDLE);
-}
-
+	leds.update(now);
+	LOOP_TIMING_MARK(STAGE_LEDS);
 
-State_type instate_AutoRunning() {
-	static unsigned long timeEnteredState = millis();
-	if (!stateEnterRan) {
-		Serial.println("Now Running.");
-		vacuum_turn_on();
-		powerled.set(POWERLED_RUNNING);
-		stateEnterRan = true;
-		timeEnteredState = millis();
+	while (Serial.available() > 0) {
+		Command(Serial.read());
 	}
-
-	if (!SystemIsArmed()) {
-		Serial.println("No longer armed, switching to Manual Idle.");
-		return changeState(STATE_MANUAL_IDLE);
+	LOOP_TIMING_SEND();
+	ledger.send();
+	ARCHIVE_SEND();
+	eventLog.drain();
+	LOOP_TIMING_MARK(STAGE_SERIAL);
+	LOOP_TIMING_END();
+
+	if (TICKLESS_LOOP) {
+		Sleep();
 	}
-
-	bool overridePressed = overrideButton.fell();
-	if (overridePressed) {
-		Serial.println("Override pressed, switching to Auto Forced Stopped.");
-		return changeState(STATE_AUTO_FORCED_STOPPED);
-	}
-
-	if(millis() - timeEnteredState > COOLDOWN) {
-		if (meter.averageW() <= MIN_WATTS + VAC_WATTS) {
-			Serial.print(meter.averageW()); Serial.print("W below threshold of "); Serial.print(MIN_WATTS + VAC_WATTS); Serial.println(", switching to Auto Cooling.");
-			return changeState(STATE_AUTO_COOLING_DOWN);
-		}
-	}
-
-	return changeState(STATE_AUTO_RUNNING);
 }
 
 
-State_type instate_AutoForcedRunning() {
-	if (!stateEnterRan) {
-		Serial.println("Now Overriding on.");
-		vacuum_turn_on();
-		powerled.set(POWERLED_RUNNING);
-		overrideled.set(BUTTONLED_FORCED_ON);
-		stateEnterRan = true;
-	}
-
-	// bool systemArmed = !powerToggle.read();
-	if (!SystemIsArmed()) {
-		return changeState(STATE_MANUAL_IDLE);
-	}
-
-	bool overridePressed = overrideButton.fell();
-	if (overridePressed) {
-		return changeState(STATE_AUTO_COOLING_DOWN);
+// Single-character serial commands.
+//   t  report the loop timings
+//   T  clear the loop timings
+//   c  forget the learned power levels and calibrate from scratch
+//   l  report the ledger of runs
+//   r  report the power archive's raw pulse intervals
+//   s  ... its seconds
+//   m  ... its minutes
+//   h  ... its hours
+void Command(int c) {
+	switch (c) {
+		case 'r':
+			ARCHIVE_REPORT(ARCHIVE_RAW);
+			break;
+		case 's':
+			ARCHIVE_REPORT(ARCHIVE_SECOND);
+			break;
+		case 'm':
+			ARCHIVE_REPORT(ARCHIVE_MINUTE);
+			break;
+		case 'h':
+			ARCHIVE_REPORT(ARCHIVE_HOUR);
+			break;
+		case 'l':
+			ledger.report();
+			break;
+		case 'c':
+			for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+				channels[i].calibration().restart();
+			}
+			break;
+		case 't':
+			LOOP_TIMING_REPORT();
+			break;
+		case 'T':
+			LOOP_TIMING_CLEAR();
+			break;
 	}
-
-	return changeState(STATE_AUTO_FORCED_RUNNING);
 }
 
 
-State_type instate_AutoForcedStopped() {
-	if (!stateEnterRan) {
-		Serial.println("Now Overriding off.");
-		vacuum_turn_off();
-		powerled.set(POWERLED_ARMED);
-		overrideled.set(BUTTONLED_FORCED_OFF);
-		stateEnterRan = true;
-	}
-
-	if (!SystemIsArmed()) {
-		return changeState(STATE_MANUAL_IDLE);
+void ReportStatus(void *) {
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		eventLog.write(LOG_STATUS, channels[i].state(), i, (int32_t)channels[i].meter().watts());
 	}
+}
 
-	bool overridePressed = overrideButton.fell();
-	if (overridePressed) {
-		return changeState(STATE_MANUAL_IDLE);
-	}
 
-	if (meter.averageW() <= MIN_WATTS + VAC_WATTS) {
-		return changeState(STATE_MANUAL_IDLE);
+// Brings the next snapshot forward when a channel changes state, though
+// no nearer than SNAPSHOT_HOLDOFF after the last.
+void SnapshotOnChange(uint32_t now) {
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		if (channels[i].state() != snapshotStates[i]) {
+			uint32_t at = lastSnapshot + SNAPSHOT_HOLDOFF;
+			if (Timers::reached(at, now)) {
+				at = now;
+			}
+			if ((int32_t)(snapshotTimer.deadline() - at) > 0) {
+				timers.startAt(snapshotTimer, at);
+			}
+			return;
+		}
 	}
-
-	return changeState(STATE_AUTO_FORCED_STOPPED);
 }
 
 
-State_type instate_AutoCoolingDown() {
-	if (!stateEnterRan) {
-		Serial.println("Now Cooling Down.");
-		powerled.set(POWERLED_ARMED);
-		overrideled.set(BUTTONLED_OFF);
-  	vacuum_turn_off();
-		stateEnterRan = true;
+// Writes a snapshot, unless nothing has moved since the last.
+void SaveSnapshot(void *) {
+	Snapshot snapshot = Snapshot();
+	snapshot.channels = CHANNEL_COUNT;
+	uint64_t pulses = 0;
+	bool changed = false;
+	for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+		channels[i].snapshot(snapshot.channel[i]);
+		pulses += snapshot.channel[i].pulses;
+		changed = changed || channels[i].state() != snapshotStates[i];
+		snapshotStates[i] = channels[i].state();
 	}
-
-	if (!SystemIsArmed()) {
-		Serial.println("Abandoning cooldown due to disarming. Switching to manual.");
-		return changeState(STATE_MANUAL_IDLE);
+	if (changed || pulses != snapshotPulses) {
+		saveSnapshot(snapshot);
+		snapshotPulses = pulses;
+		lastSnapshot = timers.now();
 	}
+	timers.start(snapshotTimer, SNAPSHOT_PERIOD);
+}
 
-	static long cooldown_entered = -1;
-	static bool seenPowerDropped = false;
-	if (cooldown_entered == -1) {
-		cooldown_entered = millis();
-		seenPowerDropped = false;
-		Serial.print(millis()); Serial.print(" Cooldown entered."); Serial.println();
-	}
 
-	if(meter.averageW() <= MIN_WATTS) {
-		seenPowerDropped = true;
+// Idles until the next thing needs doing: a timer running out, an input
+// moving or a meter pulse arriving.
+void Sleep() {
+	uint32_t at;
+	if ((eventLog.pending() || LOOP_TIMING_REPORTING() || ledger.reporting() || ARCHIVE_REPORTING()) && !drainTimer.running()) {
+		timers.start(drainTimer, LOG_DRAIN_INTERVAL);
 	}
-
-	if (seenPowerDropped && (millis() - cooldown_entered > COOLDOWN)) {
-		Serial.print(millis()); Serial.println(" Cooldown expired, switching to idle");
-		cooldown_entered = -1;
-		return changeState(STATE_AUTO_IDLE);
+	tickless.begin(millis());
+	if (timers.nextDeadline(at)) {
+		tickless.until(at);
 	}
-
-	return changeState(STATE_AUTO_COOLING_DOWN);
-}
-
-
-void vacuum_turn_on() {
-	digitalWrite(RELAY_PIN, LOW);
-}
-
-
-void vacuum_turn_off() {
-	digitalWrite(RELAY_PIN, HIGH);
+	tickless.sleep(WorkIsPending);
 }
@@ -0,0 +1,121 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Board_h
+#define Board_h
+
+#include <Arduino.h>
+
+// The boards there are profiles for. platformio.ini picks one for each
+// env with -DBOARD=BOARD_MEGA, say; without one, the board is worked out
+// from the MCU, and host builds get a profile of their own.
+#define BOARD_HOST  0
+#define BOARD_UNO   1
+#define BOARD_MICRO 2
+#define BOARD_MEGA  3
+
+#ifndef BOARD
+#if defined(ARDUINO_HOST)
+#define BOARD BOARD_HOST
+#elif defined(__AVR_ATmega2560__)
+#define BOARD BOARD_MEGA
+#elif defined(__AVR_ATmega32U4__)
+#define BOARD BOARD_MICRO
+#else
+#define BOARD BOARD_UNO
+#endif
+#endif
+
+// What a profile sets, and the settings every board shares unless its
+// profile says otherwise. The modules take their sizes from Board, the
+// profile being built for, and AutoVac.cpp its pins; it also checks
+// that the firmware's globals fit the board's SRAM, less RESERVED_RAM
+// for the stack, the heap and the Arduino core.
+struct BoardDefaults {
+  static const uint16_t SRAM = 2048;
+  static const uint16_t RESERVED_RAM = 512;
+  static const uint8_t CHANNEL_LIMIT = 1;        // Channels the RAM is planned for.
+
+  static const int8_t PULSE_PIN = 2;             // An interrupt pin on every board.
+  static const int8_t OVERRIDE_PIN = 4;
+  static const int8_t RELAY_PIN = 7;
+  static const int8_t ARMED_PIN = 8;
+  static const int8_t LED_PIN = 3;
+  static const int8_t CLAMP_PIN = A0;
+
+  static const uint8_t TIMERS_MAX = 16;          // See Timers.h,
+  static const uint8_t EVENT_LOG_SIZE = 8;       // EventLog.h,
+  static const uint8_t LEDGER_SIZE = 8;          // Ledger.h,
+  static const uint16_t AVG_WINDOW_MS = 5000;    // PowerMeter.h
+  static const uint16_t WATT_WINDOW_MS = 5000;
+  static const uint16_t ARCHIVE_RAW_BYTES = 128; // and PowerArchive.h.
+  static const uint8_t ARCHIVE_SECONDS = 30;
+  static const uint8_t ARCHIVE_MINUTES = 30;
+  static const uint8_t ARCHIVE_HOURS = 12;
+};
+
+template <uint8_t B> struct BoardTraits;
+
+// An Uno, or any ATmega328P: 2K of SRAM.
+template <> struct BoardTraits<BOARD_UNO> : BoardDefaults {
+  static const uint8_t CHANNEL_LIMIT = 2;
+};
+
+// A Pro Micro's ATmega32U4 has half a K more, some of which the USB
+// serial port takes.
+template <> struct BoardTraits<BOARD_MICRO> : BoardDefaults {
+  static const uint16_t SRAM = 2560;
+  static const uint16_t RESERVED_RAM = 640;
+  static const uint8_t CHANNEL_LIMIT = 2;
+};
+
+// A Mega 2560 has 8K: room for more channels, a longer log and ledger,
+// and the power archive (built with -DPOWER_ARCHIVE, as its env does).
+template <> struct BoardTraits<BOARD_MEGA> : BoardDefaults {
+  static const uint16_t SRAM = 8192;
+  static const uint16_t RESERVED_RAM = 1024;
+  static const uint8_t CHANNEL_LIMIT = 4;
+  static const uint8_t TIMERS_MAX = 32;
+  static const uint8_t EVENT_LOG_SIZE = 16;
+  static const uint8_t LEDGER_SIZE = 32;
+  static const uint16_t ARCHIVE_RAW_BYTES = 1024;
+  static const uint8_t ARCHIVE_SECONDS = 120;
+  static const uint8_t ARCHIVE_MINUTES = 120;
+  static const uint8_t ARCHIVE_HOURS = 96;
+};
+
+// The host HAL has a Mega's pins. Its memory is only limited so that
+// the host tools can run every channel.
+template <> struct BoardTraits<BOARD_HOST> : BoardTraits<BOARD_MEGA> {
+  static const uint16_t SRAM = 65535;
+  static const uint8_t CHANNEL_LIMIT = 8;
+};
+
+typedef BoardTraits<BOARD> Board;
+
+// The modules' globals. On the host they are thread local, as the HAL's
+// state is, so that a tool can run a channel on each of its threads;
+// AutoVac.cpp's own globals are not, and tools that run setup() and
+// loop() fork instead.
+#if defined(ARDUINO_HOST)
+#define FIRMWARE_LOCAL thread_local
+#else
+#define FIRMWARE_LOCAL
+#endif
+
+#endif
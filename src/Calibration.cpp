@@ -0,0 +1,253 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Calibration.h"
+#include "EventLog.h"
+
+
+static int32_t distance(int32_t a, int32_t b)
+{
+  return a > b ? a - b : b - a;
+}
+
+
+Calibration::Calibration()
+{
+  _baseline.watts = 0;
+  _baseline.samples = 0;
+  _vacuum = _baseline;
+  _tool = _baseline;
+  _channel = 0;
+  _state = STATE_COUNT;
+  _stateSince = 0;
+  _lastSample = 0;
+  _saved.learned = 0;
+  _saved.baselineWatts = 0;
+  _saved.vacuumWatts = 0;
+  _saved.toolWatts = 0;
+  _lastSave = 0;
+  update();
+}
+
+
+void Calibration::begin(uint8_t channel)
+{
+  _channel = channel;
+  if(loadSettings(_saved, _channel)) {
+    if(_saved.learned & LEARNED_BASELINE) {
+      _baseline.watts = _saved.baselineWatts;
+      _baseline.samples = CALIBRATION_SAMPLES;
+    }
+    if(_saved.learned & LEARNED_VACUUM) {
+      _vacuum.watts = _saved.vacuumWatts;
+      _vacuum.samples = CALIBRATION_SAMPLES;
+    }
+    if(_saved.learned & LEARNED_TOOL) {
+      _tool.watts = _saved.toolWatts;
+      _tool.samples = CALIBRATION_SAMPLES;
+    }
+  }
+  update();
+  report();
+}
+
+
+// Forgets everything learned, here and in EEPROM.
+void Calibration::restart()
+{
+  _baseline.samples = 0;
+  _vacuum.samples = 0;
+  _tool.samples = 0;
+  _saved.learned = 0;
+  saveSettings(_saved, _channel);
+  update();
+  report();
+}
+
+
+// Feeds in the meter reading, along with the state and power level the
+// firmware is in.
+void Calibration::observe(State_type state, Event_type level, int32_t watts, uint32_t now)
+{
+  if(state != _state) {
+    _state = state;
+    _stateSince = now;
+  }
+  if(now - _stateSince < CALIBRATION_SETTLE || now - _lastSample < CALIBRATION_INTERVAL) {
+    return;
+  }
+  _lastSample = now;
+
+  int32_t baseline = levelOf(_baseline, DEFAULT_BASELINE_WATTS);
+  int32_t vacuum = levelOf(_vacuum, DEFAULT_VACUUM_WATTS);
+  switch(state) {
+    case STATE_AUTO_IDLE:
+      if(level == EVENT_POWER_LOW) {
+        learn(_baseline, watts);
+      }
+      break;
+    case STATE_MANUAL_RUNNING:
+      learn(_vacuum, watts - baseline);
+      break;
+    case STATE_AUTO_RUNNING:
+      // Once the tool has stopped, the vacuum runs on alone for a while.
+      if(watts > baseline + vacuum + CALIBRATION_MIN_MARGIN) {
+        learn(_tool, watts - baseline - vacuum);
+      }
+      break;
+    default:
+      return;
+  }
+  update();
+  save(now);
+}
+
+
+// Which side of the thresholds the reading is on, given the level it
+// was on last time.
+Event_type Calibration::level(int32_t watts, Event_type current)
+{
+  int32_t start = _start;
+  int32_t high = _high;
+  if(current == EVENT_POWER_TOOL || current == EVENT_POWER_HIGH) {
+    start -= _hysteresis;
+  }
+  if(current == EVENT_POWER_HIGH) {
+    high -= _hysteresis;
+  }
+
+  if(watts <= start) {
+    return EVENT_POWER_LOW;
+  }
+  if(watts <= high) {
+    return EVENT_POWER_TOOL;
+  }
+  return EVENT_POWER_HIGH;
+}
+
+
+int32_t Calibration::startWatts()
+{
+  return _start;
+}
+
+
+int32_t Calibration::highWatts()
+{
+  return _high;
+}
+
+
+// The levels in use, learned or not.
+int32_t Calibration::baselineWatts()
+{
+  return levelOf(_baseline, DEFAULT_BASELINE_WATTS);
+}
+
+
+int32_t Calibration::vacuumWatts()
+{
+  return levelOf(_vacuum, DEFAULT_VACUUM_WATTS);
+}
+
+
+int32_t Calibration::hysteresis()
+{
+  return _hysteresis;
+}
+
+
+// A plain average until the level is trusted, then a slow moving one.
+void Calibration::learn(Level &level, int32_t watts)
+{
+  if(watts < 0) {
+    watts = 0;
+  }
+  if(level.samples < CALIBRATION_SAMPLES) {
+    level.samples++;
+    level.watts += (watts - level.watts) / level.samples;
+  } else {
+    level.watts += (watts - level.watts) / (1 << CALIBRATION_SHIFT);
+  }
+}
+
+
+void Calibration::update()
+{
+  int32_t baseline = levelOf(_baseline, DEFAULT_BASELINE_WATTS);
+  int32_t vacuum = levelOf(_vacuum, DEFAULT_VACUUM_WATTS);
+  int32_t tool = levelOf(_tool, DEFAULT_TOOL_WATTS);
+
+  int32_t margin = tool / 2;
+  if(margin < CALIBRATION_MIN_MARGIN) {
+    margin = CALIBRATION_MIN_MARGIN;
+  }
+  _start = baseline + margin;
+  _high = baseline + vacuum + margin;
+  _hysteresis = tool / 8;
+}
+
+
+// Saves the levels once they are trusted and have moved far enough, but
+// not so often as to wear out the EEPROM.
+void Calibration::save(uint32_t now)
+{
+  Settings settings = _saved;
+  settings.learned = 0;
+  if(_baseline.samples >= CALIBRATION_SAMPLES) {
+    settings.learned |= LEARNED_BASELINE;
+    settings.baselineWatts = _baseline.watts;
+  }
+  if(_vacuum.samples >= CALIBRATION_SAMPLES) {
+    settings.learned |= LEARNED_VACUUM;
+    settings.vacuumWatts = _vacuum.watts;
+  }
+  if(_tool.samples >= CALIBRATION_SAMPLES) {
+    settings.learned |= LEARNED_TOOL;
+    settings.toolWatts = _tool.watts;
+  }
+
+  bool newlyLearned = settings.learned != _saved.learned;
+  bool moved = distance(settings.baselineWatts, _saved.baselineWatts) >= CALIBRATION_SAVE_STEP
+            || distance(settings.vacuumWatts, _saved.vacuumWatts) >= CALIBRATION_SAVE_STEP
+            || distance(settings.toolWatts, _saved.toolWatts) >= CALIBRATION_SAVE_STEP;
+  if(!newlyLearned && !(moved && now - _lastSave >= CALIBRATION_SAVE_PERIOD)) {
+    return;
+  }
+
+  _saved = settings;
+  saveSettings(_saved, _channel);
+  _lastSave = now;
+  report();
+}
+
+
+void Calibration::report()
+{
+  // The hysteresis is always an eighth of the tool level, which leaves
+  // room in THRESH for the channel the LEVELS just before it belong to.
+  eventLog.write(LOG_CALIBRATION, levelOf(_baseline, DEFAULT_BASELINE_WATTS),
+                 levelOf(_vacuum, DEFAULT_VACUUM_WATTS), levelOf(_tool, DEFAULT_TOOL_WATTS));
+  eventLog.write(LOG_THRESHOLDS, _channel, _start, _high);
+}
+
+
+int32_t Calibration::levelOf(const Level &level, int32_t fallback)
+{
+  return level.samples >= CALIBRATION_SAMPLES ? level.watts : fallback;
+}
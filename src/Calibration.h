@@ -0,0 +1,104 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Calibration_h
+#define Calibration_h
+
+#include <Arduino.h>
+#include "Settings.h"
+#include "StateTable.h"
+
+// Until they have been learned, these levels give the old fixed
+// thresholds: 500W to start, and 2000W for "vacuum plus tool".
+#define DEFAULT_BASELINE_WATTS 0
+#define DEFAULT_VACUUM_WATTS   1500
+#define DEFAULT_TOOL_WATTS     1000
+
+#define CALIBRATION_SETTLE      6000   // ms in a state before its readings count; longer than the meter's average window.
+#define CALIBRATION_INTERVAL    1000   // ms between samples.
+#define CALIBRATION_SAMPLES     20     // Samples before a level is trusted.
+#define CALIBRATION_SHIFT       5      // Each sample moves a level by 1/32 of the difference.
+#define CALIBRATION_MIN_MARGIN  100    // W; the start threshold stays at least this far above the baseline.
+#define CALIBRATION_SAVE_STEP   50     // W a level must move before it is saved again.
+#define CALIBRATION_SAVE_PERIOD 600000 // ms between EEPROM saves, at most.
+
+// Learns the circuit's power levels and sets the power thresholds from
+// them.
+//
+// Three levels are tracked: the baseline, seen in STATE_AUTO_IDLE while
+// the power is low; the vacuum, from STATE_MANUAL_RUNNING less the
+// baseline; and the tool, from STATE_AUTO_RUNNING with the power high,
+// less the other two, whenever it is clearly above the vacuum alone.
+// Readings only count once a state has settled, and each level is a
+// slow moving average of them.
+//
+// The start threshold sits halfway between the baseline and the tool,
+// and the "tool plus vacuum" threshold halfway up the tool above the
+// vacuum. The level only falls back below a threshold once it is an
+// eighth of the tool's draw under it, so readings around a threshold
+// don't make the relay chatter. Rising is not held back.
+//
+// Learned levels are saved to the channel's EEPROM record when they
+// have moved, and loaded in begin(). restart() forgets them, for
+// calibrating from scratch.
+class Calibration
+{
+  public:
+    static const uint8_t LEARNED_BASELINE = 1;
+    static const uint8_t LEARNED_VACUUM = 2;
+    static const uint8_t LEARNED_TOOL = 4;
+
+    Calibration();
+    void begin(uint8_t channel = 0);
+    void restart();
+    void observe(State_type state, Event_type level, int32_t watts, uint32_t now);
+    Event_type level(int32_t watts, Event_type current);
+    int32_t startWatts();
+    int32_t highWatts();
+    int32_t baselineWatts();
+    int32_t vacuumWatts();
+    int32_t hysteresis();
+
+  private:
+    struct Level {
+      int32_t watts;
+      uint8_t samples;
+    };
+
+    void learn(Level &level, int32_t watts);
+    void update();
+    void save(uint32_t now);
+    void report();
+    int32_t levelOf(const Level &level, int32_t fallback);
+
+    Level _baseline;
+    Level _vacuum;
+    Level _tool;
+    int32_t _start;
+    int32_t _high;
+    int32_t _hysteresis;
+
+    uint8_t _channel;
+    uint8_t _state;
+    uint32_t _stateSince;
+    uint32_t _lastSample;
+    Settings _saved;
+    uint32_t _lastSave;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "ChangeDetector.h"
+
+
+ChangeDetector::ChangeDetector()
+{
+  _drift = CHANGE_DRIFT;
+  _threshold = CHANGE_THRESHOLD;
+  reset(0);
+}
+
+
+void ChangeDetector::tune(int32_t drift, int32_t threshold)
+{
+  _drift = drift;
+  _threshold = threshold;
+}
+
+
+void ChangeDetector::reset(int32_t level)
+{
+  _level = level;
+  _up = 0;
+  _down = 0;
+  _upShift = 0;
+  _downShift = 0;
+  _upSamples = 0;
+  _downSamples = 0;
+}
+
+
+// No one sample can move a sum by more than half the threshold, so it
+// takes two readings at least to call a change, and never one wild one.
+// The cap only applies to the sums that call changes; the new level is
+// worked out from the shifts as they were.
+static int32_t limit(int32_t step, int32_t bound)
+{
+  return step > bound ? bound : step < -bound ? -bound : step;
+}
+
+
+ChangeDetector::Change ChangeDetector::add(int32_t sample)
+{
+  int32_t bound = _threshold / 2;
+  int32_t shift = sample - _level - _drift;
+  _up += limit(shift, bound);
+  if(_up <= 0) {
+    _up = 0;
+    _upShift = 0;
+    _upSamples = 0;
+  } else if(_upSamples < UINT16_MAX) {
+    _upShift += shift;
+    _upSamples++;
+  }
+
+  shift = _level - sample - _drift;
+  _down += limit(shift, bound);
+  if(_down <= 0) {
+    _down = 0;
+    _downShift = 0;
+    _downSamples = 0;
+  } else if(_downSamples < UINT16_MAX) {
+    _downShift += shift;
+    _downSamples++;
+  }
+
+  if(_up >= _threshold) {
+    reset(_level + _drift + _upShift / _upSamples);
+    return CHANGE_UP;
+  }
+  if(_down >= _threshold) {
+    int32_t level = _level - _drift - _downShift / _downSamples;
+    reset(level > 0 ? level : 0);
+    return CHANGE_DOWN;
+  }
+  return CHANGE_NONE;
+}
+
+
+// The load since the last change was called.
+int32_t ChangeDetector::level()
+{
+  return _level;
+}
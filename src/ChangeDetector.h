@@ -0,0 +1,68 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef ChangeDetector_h
+#define ChangeDetector_h
+
+#include <stdint.h>
+
+#define CHANGE_DRIFT     150  // W; smaller shifts in the load are ignored.
+#define CHANGE_THRESHOLD 1000 // W-samples of shift before a change is called.
+
+// Two-sided CUSUM change-point detector.
+//
+// Each sample is compared with the current level. Shifts beyond the
+// drift allowance pile up in one sum for rises and one for falls, each
+// sample adding no more than half the threshold, and whichever passes
+// the threshold first calls a change. The new level is then the average
+// of the samples since that sum last started, however far they moved,
+// and both sums begin again.
+//
+// The threshold sets the balance: a step of S watts is called after
+// about threshold / min(S - drift, threshold / 2) samples, so never
+// fewer than two, and a lower threshold calls sooner, but also on
+// shorter spikes. The drift is about half the smallest step worth
+// calling.
+class ChangeDetector
+{
+  public:
+    enum Change {
+      CHANGE_NONE,
+      CHANGE_UP,
+      CHANGE_DOWN
+    };
+
+    ChangeDetector();
+    void tune(int32_t drift, int32_t threshold);
+    void reset(int32_t level);
+    Change add(int32_t sample);
+    int32_t level();
+
+  private:
+    int32_t _level;
+    int32_t _drift;
+    int32_t _threshold;
+    int32_t _up;
+    int32_t _down;
+    int32_t _upShift;   // The shifts in _up and _down, before the cap.
+    int32_t _downShift;
+    uint16_t _upSamples;
+    uint16_t _downSamples;
+};
+
+#endif
@@ -0,0 +1,296 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Channel.h"
+#include "Debouncer.h"
+#include "EventLog.h"
+#include "PowerArchive.h"
+#include "Telemetry.h"
+
+// Power LED Colours
+const uint32_t POWERLED_ARMED[]    = { 0, 100, 0 };
+const uint32_t POWERLED_DISARMED[] = { 0, 0, 0 };
+const uint32_t POWERLED_RUNNING[]  = { 128, 0, 0 };
+const uint32_t POWERLED_PULSE      = 50; // Blue blip for each meter pulse.
+
+// Button LED Colours
+const uint32_t BUTTONLED_OFF[]        = { 0, 0, 0 }; // Off
+const uint32_t BUTTONLED_AUTO[]       = { 0, 0, 0 }; // Green
+const uint32_t BUTTONLED_FORCED_OFF[] = { 255, 100, 0 }; // Orange
+const uint32_t BUTTONLED_FORCED_ON[]  = { 255, 0, 0 }; // Red
+
+// Entry/exit actions and timeouts, in State_type order. The transitions
+// themselves are in StateTable.h, generated from doc/fsm.dot. A channel
+// can run its cooldowns for another length with cooldown().
+const StateMachine::StateActions Channel::ACTIONS[STATE_COUNT] = {
+	{ enterManualIdle,        NULL, 0 },
+	{ enterManualRunning,     NULL, 0 },
+	{ enterAutoIdle,          NULL, 0 },
+	{ enterAutoRunning,       NULL, COOLDOWN },
+	{ enterAutoForcedRunning, NULL, 0 },
+	{ enterAutoForcedStopped, NULL, 0 },
+	{ enterAutoCoolingDown,   NULL, COOLDOWN }
+};
+
+
+Extractor::Extractor()
+{
+  _pin = NO_PIN;
+  _demand = 0;
+}
+
+
+void Extractor::attach(int pin)
+{
+  _pin = pin;
+  pinMode(_pin, OUTPUT);
+  digitalWrite(_pin, HIGH);
+}
+
+
+// The relay is active low.
+void Extractor::demand(uint8_t channel, bool on)
+{
+  if(on) {
+    _demand |= 1 << channel;
+  } else {
+    _demand &= ~(1 << channel);
+  }
+  if(_pin != NO_PIN) {
+    digitalWrite(_pin, _demand ? LOW : HIGH);
+  }
+}
+
+
+bool Extractor::running()
+{
+  return _demand != 0;
+}
+
+
+Channel::Channel() : _fsm(ACTIONS, this)
+{
+  _index = 0;
+  _config = NULL;
+  _extractor = NULL;
+  _override = -1;
+  _powerLevel = EVENT_COUNT;
+  _run.open = false;
+}
+
+
+Channel::~Channel()
+{
+  inputs.detach(_override);
+}
+
+
+// Sets how long this channel keeps the vacuum on for at least, and how
+// long it then stays off before it can start again; COOLDOWN until this
+// is called. Those are its only timed states. A timeout of 0 would mean
+// the table's own.
+void Channel::cooldown(uint32_t ms)
+{
+  _fsm.timeout(ms > 0 ? ms : 1);
+}
+
+
+// Starts in manual, or where the snapshot left off, then lets the armed
+// switch move the channel on. A snapshot's state is only resumed if it
+// is in the mode the armed switch is in now, as entering it runs its
+// action, and so drives the relay, before the armed level is dispatched;
+// otherwise the channel starts idle in the switch's mode.
+void Channel::begin(uint8_t index, const ChannelConfig &config, Extractor &extractor, bool armed,
+                    const ChannelSnapshot *snapshot)
+{
+  _index = index;
+  _config = &config;
+  _extractor = &extractor;
+
+  if(config.overridePin != NO_PIN) {
+    pinMode(config.overridePin, INPUT_PULLUP);
+    _override = inputs.attach(config.overridePin);
+  }
+  _meter.attach(config.meterPin, PowerMeter::PULSE_INTERRUPT);
+  _meter.estimator(config.estimator);
+  _meter.clamp(config.clamp);
+  _calibration.begin(index);
+
+  if(snapshot != NULL && snapshot->state < STATE_COUNT) {
+    _meter.restore(snapshot->pulses, snapshot->watts, snapshot->level);
+    State_type state = (State_type)snapshot->state;
+    if(armed != (state >= STATE_AUTO_IDLE)) {
+      state = armed ? STATE_AUTO_IDLE : STATE_MANUAL_IDLE;
+    }
+    eventLog.write(LOG_RESTORED, state, _index, snapshot->watts);
+    _fsm.begin(state);
+  } else {
+    _fsm.begin(STATE_MANUAL_IDLE);
+  }
+  this->armed(armed);
+}
+
+
+void Channel::snapshot(ChannelSnapshot &snapshot)
+{
+  snapshot.state = _fsm.state();
+  snapshot.watts = _meter.averageW();
+  snapshot.level = _meter.detector().level();
+  snapshot.pulses = _meter.pulses();
+}
+
+
+void Channel::armed(bool armed)
+{
+  _fsm.post(armed ? EVENT_ARMED : EVENT_DISARMED);
+}
+
+
+void Channel::updateMeter()
+{
+  _meter.update();
+
+  ChangeDetector::Change change = _meter.change();
+  if(change != ChangeDetector::CHANGE_NONE) {
+    eventLog.write(LOG_POWER_CHANGE, _index, change == ChangeDetector::CHANGE_UP ? 1 : -1, _meter.detector().level());
+  }
+
+  // Show a blip if a pulse was detected
+  if(_meter.pulseSeen()) {
+    TELEMETRY_PULSE(_index, _meter.pulseInterval(), _meter.pulseTime());
+    ARCHIVE_PULSE(_index, _meter.pulseInterval());
+    if(_config->powerLed != NULL) {
+      _config->powerLed->pulse(POWERLED_PULSE, 50);
+    }
+  }
+}
+
+
+// Turns input changes into events; the state machine only runs when
+// one of them has happened.
+void Channel::updateState(uint32_t now)
+{
+  if(inputs.fell(_override)) {
+    _fsm.post(EVENT_OVERRIDE);
+  }
+  int32_t watts = _meter.watts();
+  Event_type level = _calibration.level(watts, _powerLevel);
+  if(level != _powerLevel) {
+    _powerLevel = level;
+    _fsm.post(level);
+  }
+  _fsm.dispatch();
+
+  // Calibration waits for a state to settle for longer than the average
+  // window, and learns from the average, whichever estimator the levels
+  // are decided on.
+  _calibration.observe(_fsm.state(), _powerLevel, _meter.steadyW(), now);
+}
+
+
+// True while the meter has pulses waiting.
+bool Channel::pending()
+{
+  return _meter.pending();
+}
+
+
+uint8_t Channel::index()
+{
+  return _index;
+}
+
+
+State_type Channel::state()
+{
+  return _fsm.state();
+}
+
+
+PowerMeter &Channel::meter()
+{
+  return _meter;
+}
+
+
+Calibration &Channel::calibration()
+{
+  return _calibration;
+}
+
+
+StateMachine &Channel::machine()
+{
+  return _fsm;
+}
+
+
+// Logs the new state, and sets the extractor and the LEDs for it. A NULL
+// colour leaves that LED as it was. A run in the ledger goes on through
+// every state that keeps the vacuum going.
+void Channel::entered(bool vacuum, const uint32_t *powerColour, const uint32_t *overrideColour)
+{
+  eventLog.write(LOG_STATE, _fsm.state(), _index);
+  _extractor->demand(_index, vacuum);
+  if(vacuum && !_run.open) {
+    ledger.open(_run, _fsm.state(), _meter.totalMilliWh());
+  } else if(!vacuum && _run.open) {
+    ledger.close(_run, _index, _meter.totalMilliWh(), _calibration.baselineWatts(), _calibration.vacuumWatts());
+  }
+  if(powerColour != NULL && _config->powerLed != NULL) {
+    _config->powerLed->set(powerColour);
+  }
+  if(overrideColour != NULL && _config->overrideLed != NULL) {
+    _config->overrideLed->set(overrideColour);
+  }
+}
+
+
+void Channel::enterManualIdle(void *context) {
+	((Channel *)context)->entered(false, POWERLED_DISARMED, NULL);
+}
+
+
+void Channel::enterManualRunning(void *context) {
+	((Channel *)context)->entered(true, POWERLED_RUNNING, NULL);
+}
+
+
+void Channel::enterAutoIdle(void *context) {
+	((Channel *)context)->entered(false, POWERLED_ARMED, BUTTONLED_AUTO);
+}
+
+
+void Channel::enterAutoRunning(void *context) {
+	((Channel *)context)->entered(true, POWERLED_RUNNING, NULL);
+}
+
+
+void Channel::enterAutoForcedRunning(void *context) {
+	((Channel *)context)->entered(true, POWERLED_RUNNING, BUTTONLED_FORCED_ON);
+}
+
+
+void Channel::enterAutoForcedStopped(void *context) {
+	((Channel *)context)->entered(false, POWERLED_ARMED, BUTTONLED_FORCED_OFF);
+}
+
+
+void Channel::enterAutoCoolingDown(void *context) {
+	((Channel *)context)->entered(false, POWERLED_ARMED, BUTTONLED_OFF);
+}
@@ -0,0 +1,114 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Channel_h
+#define Channel_h
+
+#include <Arduino.h>
+#include "Calibration.h"
+#include "Led.h"
+#include "Ledger.h"
+#include "PowerMeter.h"
+#include "Snapshot.h"
+#include "StateMachine.h"
+
+#define CHANNEL_MAX 8 // Channels one extractor can serve; its demand is a bit per channel.
+#define NO_PIN      -1
+#define COOLDOWN    5000 // ms a run lasts at least, and after it before the vacuum can come on again; see cooldown().
+
+static_assert(CHANNEL_MAX <= SETTINGS_SLOTS, "Every channel needs its own settings record");
+static_assert(CHANNEL_MAX <= SNAPSHOT_CHANNELS, "Every channel needs room in a snapshot");
+
+// A dust extractor's relay. Several tools can share one extractor, and
+// it runs while any of their channels asks for it.
+class Extractor
+{
+  public:
+    Extractor();
+    void attach(int pin);
+    void demand(uint8_t channel, bool on);
+    bool running();
+
+  private:
+    int8_t _pin;
+    uint8_t _demand;
+};
+
+// How one tool circuit is wired up.
+struct ChannelConfig {
+  int8_t meterPin;                    // The circuit's S0 pulse output.
+  int8_t overridePin;                 // Its override button, or NO_PIN.
+  uint8_t extractor;                  // Which extractor the tool's dust goes to.
+  PowerMeter::Estimator estimator;
+  CurrentSensor *clamp;               // A CT clamp on the circuit, or NULL.
+  Led *powerLed;                      // Either may be NULL.
+  Led *overrideLed;
+};
+
+// One tool circuit: its meter, its state machine and the thresholds
+// learned for it, driving the extractor the tool is piped to.
+//
+// begin() can be given a snapshot to carry on from, after a reset.
+// Each run of the vacuum it asks for goes into the ledger once it ends.
+//
+// Once the debouncer has sampled the inputs, the loop runs every channel
+// through updateMeter() and then updateState(). The master armed switch
+// is shared, and is passed in with armed().
+class Channel
+{
+  public:
+    Channel();
+    ~Channel();
+    void cooldown(uint32_t ms);
+    void begin(uint8_t index, const ChannelConfig &config, Extractor &extractor, bool armed,
+               const ChannelSnapshot *snapshot = NULL);
+    void snapshot(ChannelSnapshot &snapshot);
+    void armed(bool armed);
+    void updateMeter();
+    void updateState(uint32_t now);
+    bool pending();
+    uint8_t index();
+    State_type state();
+    PowerMeter &meter();
+    Calibration &calibration();
+    StateMachine &machine();
+
+  private:
+    static const StateMachine::StateActions ACTIONS[STATE_COUNT];
+    static void enterManualIdle(void *context);
+    static void enterManualRunning(void *context);
+    static void enterAutoIdle(void *context);
+    static void enterAutoRunning(void *context);
+    static void enterAutoForcedRunning(void *context);
+    static void enterAutoForcedStopped(void *context);
+    static void enterAutoCoolingDown(void *context);
+
+    void entered(bool vacuum, const uint32_t *powerColour, const uint32_t *overrideColour);
+
+    uint8_t _index;
+    const ChannelConfig *_config;
+    Extractor *_extractor;
+    PowerMeter _meter;
+    StateMachine _fsm;
+    Calibration _calibration;
+    int8_t _override; // The override button's input in the debouncer.
+    Event_type _powerLevel;
+    LedgerRun _run;
+};
+
+#endif
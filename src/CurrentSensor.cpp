@@ -0,0 +1,220 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "CurrentSensor.h"
+
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+
+ISR(ADC_vect)
+{
+  CurrentSensor::converted(ADC);
+}
+#endif
+
+const int32_t CURRENT_MIDPOINT = 512L << CURRENT_OFFSET_SHIFT; // Where the bias should sit, half the reference.
+
+FIRMWARE_LOCAL CurrentSensor *CurrentSensor::_active = NULL;
+
+
+// The integer square root, rounded down.
+static uint16_t isqrt(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while(bit > value) {
+    bit >>= 2;
+  }
+  while(bit != 0) {
+    if(value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+
+CurrentSensor::CurrentSensor(int pin)
+{
+  _pin = pin;
+  _offset = CURRENT_MIDPOINT;
+  _squares = 0;
+  _samples = 0;
+  _cycleSquares = 0;
+  _ready = false;
+  _overrunCount = 0;
+  _overrunMark = 0;
+  _overruns = 0;
+  _cycleThisFrame = false;
+  _milliamps = 0;
+  _watts = 0;
+}
+
+
+CurrentSensor::~CurrentSensor()
+{
+  if(_active != this) {
+    return;
+  }
+#if defined(__AVR__)
+  ADCSRA = 0;
+#else
+  hostAdcFreeRun(0, 0, NULL);
+#endif
+  _active = NULL;
+}
+
+
+// Starts the ADC converting the clamp's pin over and over, from a clock
+// of 16MHz / 128.
+void CurrentSensor::begin()
+{
+  if(_pin < 0) {
+    return;
+  }
+  noInterrupts();
+  _active = this;
+  _squares = 0;
+  _samples = 0;
+  _ready = false;
+  interrupts();
+  _wattsAverage.clear();
+
+#if defined(__AVR__)
+  uint8_t channel = _pin >= A0 ? _pin - A0 : _pin;
+#if defined(analogPinToChannel)
+  channel = analogPinToChannel(channel);
+#endif
+  ADMUX = _BV(REFS0) | (channel & 0x07);
+#if defined(MUX5)
+  ADCSRB = (channel & 0x08) ? _BV(MUX5) : 0; // And auto-triggering free runs.
+#else
+  ADCSRB = 0;
+#endif
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#else
+  hostAdcFreeRun(_pin, 1000000UL / CURRENT_SAMPLE_RATE, converted);
+#endif
+}
+
+
+// Takes the last mains cycle's sum from the ISR, if there is a new one.
+void CurrentSensor::update()
+{
+  noInterrupts();
+  bool ready = _ready;
+  uint32_t squares = _cycleSquares;
+  uint8_t overrunCount = _overrunCount;
+  _ready = false;
+  interrupts();
+
+  _overruns += (uint8_t)(overrunCount - _overrunMark);
+  _overrunMark = overrunCount;
+  if(!ready) {
+    return;
+  }
+
+  // The RMS in sixteenths of a count. A cycle's squares are at most
+  // 192 * 1023^2, so they can take four bits of headroom before the
+  // divide, and the mean square the rest after it.
+  uint32_t meanSquare = (squares << 4) / CURRENT_CYCLE_SAMPLES;
+  uint16_t rms = isqrt(meanSquare << 4);
+  _milliamps = ((int32_t)rms * CURRENT_MA_PER_COUNT + 8) >> 4;
+  _watts = (_milliamps * MAINS_VOLTS + 500) / 1000;
+  _wattsAverage.addValue(_watts);
+  _cycleThisFrame = true;
+}
+
+
+// True once after each mains cycle update() has measured.
+bool CurrentSensor::cycleSeen()
+{
+  bool seen = _cycleThisFrame;
+  _cycleThisFrame = false;
+  return seen;
+}
+
+
+// True while a finished cycle is waiting for update().
+bool CurrentSensor::pending()
+{
+  return _ready;
+}
+
+
+// The true RMS current over the last mains cycle.
+int32_t CurrentSensor::milliamps()
+{
+  return _milliamps;
+}
+
+
+// The apparent power over the last mains cycle, at MAINS_VOLTS.
+int32_t CurrentSensor::watts()
+{
+  return _watts;
+}
+
+
+// The apparent power over the last CURRENT_AVERAGE cycles.
+float CurrentSensor::averageW()
+{
+  return _wattsAverage.getAverage();
+}
+
+
+// Cycles the ISR finished before update() had taken the one before.
+unsigned long CurrentSensor::overruns()
+{
+  return _overruns;
+}
+
+
+void CurrentSensor::converted(uint16_t value)
+{
+  if(_active != NULL) {
+    _active->sample(value);
+  }
+}
+
+
+// Runs in the ISR. The bias moves by 1/2^CURRENT_OFFSET_SHIFT of each
+// sample's distance from it, so it settles on the waveform's mean; the
+// mains itself is far too quick for it to follow.
+void CurrentSensor::sample(uint16_t value)
+{
+  int16_t centred = (int16_t)value - (int16_t)((_offset + (1L << (CURRENT_OFFSET_SHIFT - 1))) >> CURRENT_OFFSET_SHIFT);
+  _offset += centred;
+  _squares += (uint32_t)((int32_t)centred * centred);
+  if(++_samples < CURRENT_CYCLE_SAMPLES) {
+    return;
+  }
+
+  // A cycle update() hasn't taken yet is replaced with this one.
+  if(_ready) {
+    _overrunCount++;
+  }
+  _cycleSquares = _squares;
+  _ready = true;
+  _squares = 0;
+  _samples = 0;
+}
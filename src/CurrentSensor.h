@@ -0,0 +1,89 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef CurrentSensor_h
+#define CurrentSensor_h
+
+#include <Arduino.h>
+#include "Board.h"
+#include "RunningAverage.h"
+
+#define MAINS_HZ              50
+#define MAINS_VOLTS           230  // Nominal; the clamp only sees current, so the power is apparent power.
+#define CURRENT_SAMPLE_RATE   9615 // Conversions a second: 16MHz, the ADC clock divided by 128, 13 clocks each.
+#define CURRENT_CYCLE_SAMPLES (CURRENT_SAMPLE_RATE / MAINS_HZ) // Samples summed per RMS figure, one mains cycle.
+#define CURRENT_MA_PER_COUNT  146  // An SCT-013-030 (30A per volt) on the 5V reference: 5000mV / 1024 * 30.
+#define CURRENT_OFFSET_SHIFT  12   // The bias filter's time constant, 2^12 samples (0.4s).
+#define CURRENT_AVERAGE       8    // Mains cycles behind averageW().
+
+static_assert(CURRENT_CYCLE_SAMPLES < 256, "A cycle's samples are counted in a byte");
+
+// A CT clamp round one of a circuit's conductors, read by the ADC, as a
+// second source of power readings next to the meter's S0 pulses. It sees
+// a change in load within a mains cycle, where the pulses can take
+// seconds.
+//
+// The ADC converts continuously and interrupts with each sample. The ISR
+// takes off the clamp's bias, which a very slow high-pass filter follows,
+// and sums the squares of what is left in integers. At the end of each
+// mains cycle it hands the sum over to update(), which takes the square
+// root for the true RMS current and so the apparent power.
+//
+// There is one ADC, so only one sensor can be running; begin() takes it
+// over from any other. analogRead() can't be used while one is.
+class CurrentSensor
+{
+  public:
+    CurrentSensor(int pin);
+    ~CurrentSensor();
+    void begin();
+    void update();
+    bool cycleSeen();
+    bool pending();
+    int32_t milliamps();
+    int32_t watts();
+    float averageW();
+    unsigned long overruns();
+
+    // Each ADC result, from its interrupt.
+    static void converted(uint16_t value);
+
+  private:
+    static FIRMWARE_LOCAL CurrentSensor *_active;
+
+    void sample(uint16_t value);
+
+    int8_t _pin;
+
+    // The ISR's side.
+    int32_t _offset;              // The bias, in 1/2^CURRENT_OFFSET_SHIFT counts.
+    uint32_t _squares;
+    uint8_t _samples;
+    volatile uint32_t _cycleSquares;
+    volatile bool _ready;
+    volatile uint8_t _overrunCount; // Cycles replaced before update() took them.
+
+    uint8_t _overrunMark;
+    unsigned long _overruns;
+    bool _cycleThisFrame;
+    int32_t _milliamps;
+    int32_t _watts;
+    RunningAverage<int32_t, CURRENT_AVERAGE> _wattsAverage;
+};
+
+#endif
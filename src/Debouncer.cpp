@@ -0,0 +1,182 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Debouncer.h"
+
+FIRMWARE_LOCAL Debouncer inputs;
+
+
+Debouncer::Debouncer()
+{
+  for(uint8_t i = 0; i < DEBOUNCE_INPUTS; i++) {
+    _registers[i] = NULL;
+    _masks[i] = 0;
+  }
+  _portCount = 0;
+  _state = 0;
+  _count0 = 0;
+  _count1 = 0;
+  _rose = 0;
+  _fell = 0;
+  _lastSample = 0;
+}
+
+
+// Starts debouncing the pin from its present level, and returns the
+// input number to ask about it with, or -1 if every input is taken. The
+// pin mode is up to the caller.
+int8_t Debouncer::attach(uint8_t pin)
+{
+  uint8_t port = digitalPinToPort(pin);
+  if(port == NOT_A_PORT) {
+    return -1;
+  }
+  int8_t input = 0;
+  while(_masks[input] != 0) {
+    if(++input == DEBOUNCE_INPUTS) {
+      return -1;
+    }
+  }
+
+  uint8_t bit = 1 << input;
+  _registers[input] = portInputRegister(port);
+  _masks[input] = digitalPinToBitMask(pin);
+  if(*_registers[input] & _masks[input]) {
+    _state |= bit;
+  } else {
+    _state &= ~bit;
+  }
+  _count0 &= ~bit;
+  _count1 &= ~bit;
+  findPorts();
+  return input;
+}
+
+
+void Debouncer::detach(int8_t input)
+{
+  if(input < 0 || input >= DEBOUNCE_INPUTS) {
+    return;
+  }
+  uint8_t bit = 1 << input;
+  _masks[input] = 0;
+  _state &= ~bit;
+  _count0 &= ~bit;
+  _count1 &= ~bit;
+  _rose &= ~bit;
+  _fell &= ~bit;
+  findPorts();
+}
+
+
+// Counts a sample of the inputs if DEBOUNCE_PERIOD has passed since the
+// last one. A free input always reads 0, as its state does.
+void Debouncer::update(uint32_t now)
+{
+  _rose = 0;
+  _fell = 0;
+  uint8_t levels = sample();
+  if((int32_t)(now - _lastSample) >= DEBOUNCE_PERIOD) {
+    _lastSample = now;
+    uint8_t delta = levels ^ _state;
+    _count1 = (_count1 ^ _count0) & delta;
+    _count0 = ~_count0 & delta;
+    uint8_t toggle = delta & ~(_count0 | _count1);
+    _state ^= toggle;
+    _rose = toggle & _state;
+    _fell = toggle & ~_state;
+  }
+
+  // An input that has moved, even between samples, needs the next
+  // sample to come on time.
+  if((levels ^ _state) != 0) {
+    timers.startAt(_timer, _lastSample + DEBOUNCE_PERIOD);
+  } else {
+    timers.stop(_timer);
+  }
+}
+
+
+bool Debouncer::read(int8_t input)
+{
+  return input >= 0 && (_state & (1 << input));
+}
+
+
+bool Debouncer::rose(int8_t input)
+{
+  return input >= 0 && (_rose & (1 << input));
+}
+
+
+bool Debouncer::fell(int8_t input)
+{
+  return input >= 0 && (_fell & (1 << input));
+}
+
+
+// The inputs that went high in the last update(), a bit each.
+uint8_t Debouncer::rose()
+{
+  return _rose;
+}
+
+
+uint8_t Debouncer::fell()
+{
+  return _fell;
+}
+
+
+// One read of each port, then a bit from it for each input on it.
+uint8_t Debouncer::sample()
+{
+  uint8_t ports[DEBOUNCE_INPUTS];
+  for(uint8_t p = 0; p < _portCount; p++) {
+    ports[p] = *_ports[p];
+  }
+  uint8_t levels = 0;
+  for(uint8_t i = 0; i < DEBOUNCE_INPUTS; i++) {
+    if(_masks[i] != 0 && (ports[_portOf[i]] & _masks[i])) {
+      levels |= 1 << i;
+    }
+  }
+  return levels;
+}
+
+
+// Lists the distinct port registers, so that each is read once however
+// many inputs share it.
+void Debouncer::findPorts()
+{
+  _portCount = 0;
+  for(uint8_t i = 0; i < DEBOUNCE_INPUTS; i++) {
+    _portOf[i] = 0;
+    if(_masks[i] == 0) {
+      continue;
+    }
+    uint8_t p = 0;
+    while(p < _portCount && _ports[p] != _registers[i]) {
+      p++;
+    }
+    if(p == _portCount) {
+      _ports[_portCount++] = _registers[i];
+    }
+    _portOf[i] = p;
+  }
+}
@@ -0,0 +1,74 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Debouncer_h
+#define Debouncer_h
+
+#include <Arduino.h>
+#include "Board.h"
+#include "Timers.h"
+
+#define DEBOUNCE_INPUTS 8 // Inputs debounced together; one bit each in the counters.
+#define DEBOUNCE_PERIOD 6 // ms between samples. An input has to hold for four, 18-24ms in all.
+
+// Debounces every digital input at once, a bit per input.
+//
+// update() reads each port register the inputs are on once, gathers
+// their bits into a byte and runs it through a two-bit vertical
+// counter: bit n of _count0 and _count1 together count how many samples
+// in a row input n has differed from its debounced state. The fourth
+// one flips the state, and the flipped bits are the edges for rose()
+// and fell(), which hold until the next update(). Whatever the number
+// of inputs, that is a handful of byte operations per sample.
+//
+// While any input is away from its debounced state, a timer keeps the
+// loop waking for the next sample.
+class Debouncer
+{
+  public:
+    Debouncer();
+    int8_t attach(uint8_t pin);
+    void detach(int8_t input);
+    void update(uint32_t now);
+    bool read(int8_t input);
+    bool rose(int8_t input);
+    bool fell(int8_t input);
+    uint8_t rose();
+    uint8_t fell();
+
+  private:
+    uint8_t sample();
+    void findPorts();
+
+    volatile uint8_t *_registers[DEBOUNCE_INPUTS];
+    uint8_t _masks[DEBOUNCE_INPUTS];  // 0 for a free input.
+    volatile uint8_t *_ports[DEBOUNCE_INPUTS];
+    uint8_t _portOf[DEBOUNCE_INPUTS];
+    uint8_t _portCount;
+    uint8_t _state;
+    uint8_t _count0;
+    uint8_t _count1;
+    uint8_t _rose;
+    uint8_t _fell;
+    uint32_t _lastSample;
+    Timer _timer;
+};
+
+extern FIRMWARE_LOCAL Debouncer inputs;
+
+#endif
@@ -0,0 +1,215 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "EventLog.h"
+#include <HardwareSerial.h>
+#include <util/crc16.h>
+
+static_assert((EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)) == 0 && EVENT_LOG_SIZE <= 128,
+              "EVENT_LOG_SIZE must be a power of two up to 128");
+static_assert(LOG_MESSAGE_COUNT < 256, "Log message ids must fit a byte");
+static_assert(EVENT_LOG_PACKED < 254, "A packed record must fit one COBS block");
+
+FIRMWARE_LOCAL EventLog eventLog;
+
+#ifdef EVENT_LOG_TEXT
+#include <avr/pgmspace.h>
+
+// The message names live in flash, and only when they are sent as text.
+#define LOG_CATALOG_NAME(id, name, format, arguments) static const char id##_NAME[] PROGMEM = name;
+LOG_CATALOG(LOG_CATALOG_NAME)
+#undef LOG_CATALOG_NAME
+
+#define LOG_CATALOG_ENTRY(id, name, format, arguments) id##_NAME,
+static const char *const LOG_NAMES[] PROGMEM = {
+  LOG_CATALOG(LOG_CATALOG_ENTRY)
+};
+#undef LOG_CATALOG_ENTRY
+
+static uint8_t appendNumber(uint8_t *out, int32_t value)
+{
+  uint8_t n = 0;
+  uint32_t magnitude = value;
+  if(value < 0) {
+    out[n++] = '-';
+    magnitude = -(uint32_t)value;
+  }
+  char digits[10];
+  uint8_t count = 0;
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while(magnitude != 0);
+  while(count > 0) {
+    out[n++] = digits[--count];
+  }
+  return n;
+}
+#endif
+
+
+EventLog::EventLog()
+{
+  _head = 0;
+  _tail = 0;
+  _frameLength = 0;
+  _frameSent = 0;
+  _dropped = 0;
+  _droppedReported = 0;
+}
+
+
+void EventLog::write(LogMessage id, int32_t a, int32_t b, int32_t c)
+{
+  if(!push(id, a, b, c)) {
+    _dropped++;
+  }
+}
+
+
+void EventLog::drain()
+{
+  // Say how much was lost as soon as there is room to.
+  if(_dropped != _droppedReported && push(LOG_DROPPED, _dropped, 0, 0)) {
+    _droppedReported = _dropped;
+  }
+
+  int space = Serial.availableForWrite();
+  while(space > 0) {
+    if(_frameSent == _frameLength) {
+      if(_tail == _head) {
+        return;
+      }
+      _frameLength = encode(_records[_tail & (EVENT_LOG_SIZE - 1)], _frame);
+      _frameSent = 0;
+      _tail++;
+    }
+
+    uint8_t n = _frameLength - _frameSent;
+    if(n > space) {
+      n = space;
+    }
+    Serial.write(_frame + _frameSent, n);
+    _frameSent += n;
+    space -= n;
+  }
+}
+
+
+// True while there are records or part of one still to send.
+bool EventLog::pending()
+{
+  return _tail != _head || _frameSent != _frameLength || _dropped != _droppedReported;
+}
+
+
+// How many records can be written without dropping any.
+uint8_t EventLog::space()
+{
+  return EVENT_LOG_SIZE - (uint8_t)(_head - _tail);
+}
+
+
+unsigned long EventLog::dropped()
+{
+  return _dropped;
+}
+
+
+bool EventLog::push(uint8_t id, int32_t a, int32_t b, int32_t c)
+{
+  if((uint8_t)(_head - _tail) >= EVENT_LOG_SIZE) {
+    return false;
+  }
+  Record &record = _records[_head & (EVENT_LOG_SIZE - 1)];
+  record.id = id;
+  record.time = millis();
+  record.args[0] = a;
+  record.args[1] = b;
+  record.args[2] = c;
+  _head++;
+  return true;
+}
+
+
+#ifdef EVENT_LOG_TEXT
+uint8_t EventLog::encode(const Record &record, uint8_t *out)
+{
+  uint8_t n = appendNumber(out, record.time);
+  out[n++] = ' ';
+  PGM_P name = (PGM_P)pgm_read_ptr(&LOG_NAMES[record.id]);
+  for(char c; (c = pgm_read_byte(name)) != 0 && n < 19; name++) {
+    out[n++] = c;
+  }
+  for(uint8_t arg = 0; arg < EVENT_LOG_ARGS; arg++) {
+    out[n++] = ' ';
+    n += appendNumber(out + n, record.args[arg]);
+  }
+  out[n++] = '\n';
+  return n;
+}
+#else
+static uint8_t appendVarint(uint8_t *out, uint32_t value)
+{
+  uint8_t n = 0;
+  while(value >= 0x80) {
+    out[n++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  out[n++] = value;
+  return n;
+}
+
+
+uint8_t EventLog::encode(const Record &record, uint8_t *out)
+{
+  // Packed one byte into the frame, leaving room for COBS to be done in
+  // place.
+  uint8_t *packed = out + 1;
+  uint8_t n = 0;
+  packed[n++] = record.id;
+  n += appendVarint(packed + n, record.time);
+  uint8_t args = EVENT_LOG_ARGS;
+  while(args > 0 && record.args[args - 1] == 0) {
+    args--;
+  }
+  for(uint8_t arg = 0; arg < args; arg++) {
+    int32_t value = record.args[arg];
+    n += appendVarint(packed + n, (uint32_t)value << 1 ^ (uint32_t)(value >> 31));
+  }
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 0; i < n; i++) {
+    crc = _crc_ccitt_update(crc, packed[i]);
+  }
+  packed[n++] = crc;
+  packed[n++] = crc >> 8;
+
+  // Each zero becomes the distance on to the next one, the byte in front
+  // the distance to the first, and the last the distance to the end.
+  uint8_t code = 0;
+  for(uint8_t i = 1; i <= n; i++) {
+    if(out[i] == 0) {
+      out[code] = i - code;
+      code = i;
+    }
+  }
+  out[code] = n + 1 - code;
+  out[n + 1] = 0;
+  return n + 2;
+}
+#endif
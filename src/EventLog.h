@@ -0,0 +1,98 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef EventLog_h
+#define EventLog_h
+
+#include <Arduino.h>
+#include "Board.h"
+#include "LogCatalog.h"
+
+// #define EVENT_LOG_TEXT 1 // Send "time NAME a b c" lines instead of binary records.
+
+#define EVENT_LOG_SIZE Board::EVENT_LOG_SIZE // Records; must be a power of two.
+#define EVENT_LOG_ARGS 3
+
+// A packed record is the id, the time and the arguments as varints of up
+// to five bytes each, then the CRC. COBS adds a byte, and the frame ends
+// with a zero.
+#define EVENT_LOG_PACKED (1 + 5 + 5 * EVENT_LOG_ARGS + 2)
+
+#ifdef EVENT_LOG_TEXT
+#define EVENT_LOG_FRAME (10 + 1 + 8 + EVENT_LOG_ARGS * 12 + 1)
+#else
+#define EVENT_LOG_FRAME (EVENT_LOG_PACKED + 2)
+#endif
+
+// Message ids, from the catalog in LogCatalog.h.
+#define LOG_CATALOG_ID(id, name, format, arguments) id,
+enum LogMessage {
+  LOG_CATALOG(LOG_CATALOG_ID)
+  LOG_MESSAGE_COUNT
+};
+#undef LOG_CATALOG_ID
+
+// Fixed-size binary log records, queued in RAM and sent a few bytes at a
+// time so that logging never waits on the UART.
+//
+// write() only copies the record into the ring; a full ring drops the
+// record and counts it. drain() hands over as many bytes as the serial
+// transmit buffer has room for, and reports drops with a LOG_DROPPED
+// record once there is space again. Both are for the main loop only.
+//
+// On the wire each record is the id, the millis() timestamp as a
+// varint (seven bits a byte, low first) and the arguments as zigzag
+// varints, with trailing zero arguments left off, then the CRC-CCITT of
+// all that, low byte first. The lot is COBS-encoded so that it has no
+// zero bytes in it, and sent with a zero after it, so a reader can pick
+// up at the next zero whatever it joined or lost. With EVENT_LOG_TEXT,
+// for reading on a plain serial monitor, it is a line with the message
+// name from flash instead.
+class EventLog
+{
+  public:
+    struct Record {
+      uint8_t id;
+      uint32_t time;
+      int32_t args[EVENT_LOG_ARGS];
+    };
+
+    EventLog();
+    void write(LogMessage id, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+    void drain();
+    bool pending();
+    uint8_t space();
+    unsigned long dropped();
+
+  private:
+    bool push(uint8_t id, int32_t a, int32_t b, int32_t c);
+    uint8_t encode(const Record &record, uint8_t *out);
+
+    Record _records[EVENT_LOG_SIZE];
+    uint8_t _head;
+    uint8_t _tail;
+    uint8_t _frame[EVENT_LOG_FRAME];
+    uint8_t _frameLength;
+    uint8_t _frameSent;
+    unsigned long _dropped;
+    unsigned long _droppedReported;
+};
+
+extern FIRMWARE_LOCAL EventLog eventLog;
+
+#endif
@@ -0,0 +1,70 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Fixed_h
+#define Fixed_h
+
+#include <stdint.h>
+
+// Signed Q-format fixed point number in 32 bits, with FRAC fractional
+// bits. Addition and subtraction are exact, which is what lets
+// RunningAverage keep an exact running sum without an FPU.
+template <uint8_t FRAC>
+class Fixed
+{
+  public:
+    static const int32_t ONE = (int32_t)1 << FRAC;
+
+    constexpr Fixed() : _raw(0) {}
+    constexpr Fixed(int value) : _raw((int32_t)value * ONE) {}
+
+    static constexpr Fixed fromRaw(int32_t raw) { return Fixed(raw, true); }
+    static constexpr Fixed fromFloat(float value)
+    {
+      return Fixed((int32_t)(value * ONE + (value < 0 ? -0.5f : 0.5f)), true);
+    }
+
+    constexpr int32_t raw() const { return _raw; }
+    constexpr float toFloat() const { return (float)_raw / ONE; }
+    constexpr int32_t toInt() const { return _raw / ONE; }
+
+    constexpr Fixed operator+(Fixed other) const { return Fixed(_raw + other._raw, true); }
+    constexpr Fixed operator-(Fixed other) const { return Fixed(_raw - other._raw, true); }
+    constexpr Fixed operator-() const { return Fixed(-_raw, true); }
+    constexpr Fixed operator*(int32_t n) const { return Fixed(_raw * n, true); }
+    constexpr Fixed operator/(int32_t n) const { return Fixed(_raw / n, true); }
+    Fixed &operator+=(Fixed other) { _raw += other._raw; return *this; }
+    Fixed &operator-=(Fixed other) { _raw -= other._raw; return *this; }
+
+    constexpr bool operator==(Fixed other) const { return _raw == other._raw; }
+    constexpr bool operator!=(Fixed other) const { return _raw != other._raw; }
+    constexpr bool operator<(Fixed other) const { return _raw < other._raw; }
+    constexpr bool operator>(Fixed other) const { return _raw > other._raw; }
+    constexpr bool operator<=(Fixed other) const { return _raw <= other._raw; }
+    constexpr bool operator>=(Fixed other) const { return _raw >= other._raw; }
+
+  private:
+    constexpr Fixed(int32_t raw, bool) : _raw(raw) {}
+
+    int32_t _raw;
+};
+
+typedef Fixed<8> Q8;   // Q23.8: +/-8M with 1/256 resolution.
+typedef Fixed<16> Q16; // Q15.16: +/-32K with 1/65536 resolution.
+
+#endif
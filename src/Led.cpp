@@ -19,31 +19,21 @@
 #include "Led.h"
 
 
-Led::Led(Adafruit_NeoPixel strip, int id) {
-								_pulseExpires = 0;
-								_inPulse = false;
-								_colour = 0;
-								_strip = strip;
+Led::Led(LedStrip &strip, uint8_t id) : _strip(strip) {
 								_id = id;
 }
 
 
-void Led::update() {
-								if (_inPulse && _pulseExpires <= millis()) {
-																_strip.setPixelColor(_id, _colour);
-																_inPulse = false;
-								}
+void Led::set(const uint32_t colour[]) {
+								_strip.set(_id, Adafruit_NeoPixel::Color(colour[0], colour[1], colour[2]));
 }
 
 
-void Led::set(const uint32_t colour[]) {
-								_colour = _strip.Color(colour[0], colour[1], colour[2]);
-								_strip.setPixelColor(_id, _colour);
+void Led::pulse(uint32_t colour, long duration) {
+								_strip.pulse(_id, colour, duration);
 }
 
 
-void Led::pulse(uint32_t colour, long duration) {
-								_pulseExpires = millis() + duration;
-								_inPulse = true;
-								_strip.setPixelColor(_id, colour);
+void Led::blink(uint32_t colour, long period) {
+								_strip.blink(_id, colour, period);
 }
@@ -19,22 +19,20 @@
 #ifndef Led_h
 #define Led_h
 
-#include <Adafruit_NeoPixel.h>
+#include "LedStrip.h"
 
+// One pixel of a shared LedStrip.
 class Led
 {
 public:
-Led(Adafruit_NeoPixel strip, int id);
-void update();
+Led(LedStrip &strip, uint8_t id);
 void set(const uint32_t colour[]);
 void pulse(uint32_t colour, long duration);
+void blink(uint32_t colour, long period);
 
 private:
-Adafruit_NeoPixel _strip;
-int _id;
-uint32_t _colour;
-uint32_t _pulseExpires;
-bool _inPulse;
+LedStrip &_strip;
+uint8_t _id;
 };
 
 #endif
@@ -0,0 +1,163 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "LedStrip.h"
+
+
+LedStrip::LedStrip(Adafruit_NeoPixel &strip) : _strip(strip)
+{
+  _pixels = 0;
+  _dirty = false;
+  _now = 0;
+  _shows = 0;
+  for(uint8_t i = 0; i < LED_MAX_PIXELS; i++) {
+    _animations[i].effect = LED_STEADY;
+    _animations[i].steady = 0;
+    _animations[i].colour = 0;
+    _animations[i].start = 0;
+    _animations[i].period = 0;
+    _frame[i] = 0;
+  }
+}
+
+
+void LedStrip::begin(uint8_t brightness)
+{
+  _pixels = _strip.numPixels() < LED_MAX_PIXELS ? _strip.numPixels() : LED_MAX_PIXELS;
+  _strip.begin();
+  _strip.setBrightness(brightness);
+  for(uint8_t i = 0; i < _pixels; i++) {
+    _strip.setPixelColor(i, _frame[i]);
+  }
+  _strip.show();
+  _shows++;
+  _dirty = false;
+}
+
+
+// Sets the colour a pixel shows when no effect is running on it.
+void LedStrip::set(uint8_t pixel, uint32_t colour)
+{
+  if(pixel < LED_MAX_PIXELS) {
+    _animations[pixel].steady = colour;
+  }
+}
+
+
+// Shows colour on the pixel for duration millis, then goes back to the
+// steady colour.
+void LedStrip::pulse(uint8_t pixel, uint32_t colour, uint32_t duration)
+{
+  if(pixel < LED_MAX_PIXELS) {
+    Animation &animation = _animations[pixel];
+    animation.effect = LED_PULSE;
+    animation.colour = colour;
+    animation.start = timers.now();
+    animation.period = duration;
+  }
+}
+
+
+// Alternates between colour and the steady colour every period millis,
+// until a pulse replaces it. A period of 0 stops it.
+void LedStrip::blink(uint8_t pixel, uint32_t colour, uint32_t period)
+{
+  if(pixel < LED_MAX_PIXELS) {
+    Animation &animation = _animations[pixel];
+    animation.effect = period > 0 ? LED_BLINK : LED_STEADY;
+    animation.colour = colour;
+    animation.start = timers.now();
+    animation.period = period;
+  }
+}
+
+
+void LedStrip::update(uint32_t now)
+{
+  _now = now;
+  for(uint8_t i = 0; i < _pixels; i++) {
+    uint32_t colour = colourAt(_animations[i], now);
+    if(colour != _frame[i]) {
+      _frame[i] = colour;
+      _strip.setPixelColor(i, colour);
+      _dirty = true;
+    }
+  }
+
+  if(_dirty) {
+    _strip.show();
+    _shows++;
+    _dirty = false;
+  }
+
+  uint32_t at;
+  if(nextDeadline(at)) {
+    timers.startAt(_timer, at);
+  } else {
+    timers.stop(_timer);
+  }
+}
+
+
+// When an animation will next change the frame, if one is running.
+bool LedStrip::nextDeadline(uint32_t &at)
+{
+  bool running = false;
+  for(uint8_t i = 0; i < _pixels; i++) {
+    const Animation &animation = _animations[i];
+    if(animation.effect == LED_STEADY) {
+      continue;
+    }
+
+    uint32_t next = animation.start + animation.period;
+    if(animation.effect == LED_BLINK) {
+      next += ((_now - animation.start) / animation.period) * animation.period;
+    }
+    if(!running || (int32_t)(next - at) < 0) {
+      at = next;
+    }
+    running = true;
+  }
+  return running;
+}
+
+
+unsigned long LedStrip::shows()
+{
+  return _shows;
+}
+
+
+uint32_t LedStrip::colourAt(Animation &animation, uint32_t now)
+{
+  uint32_t elapsed = now - animation.start;
+  switch(animation.effect) {
+    case LED_PULSE:
+      if(elapsed < animation.period) {
+        return animation.colour;
+      }
+      animation.effect = LED_STEADY;
+      break;
+    case LED_BLINK:
+      if((elapsed / animation.period) % 2 == 0) {
+        return animation.colour;
+      }
+      break;
+  }
+  return animation.steady;
+}
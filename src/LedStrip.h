@@ -0,0 +1,74 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef LedStrip_h
+#define LedStrip_h
+
+#include <Adafruit_NeoPixel.h>
+#include "Timers.h"
+
+#define LED_MAX_PIXELS 4
+
+// Composes the frame for a NeoPixel strip and only sends it when it
+// has changed.
+//
+// Sending a frame turns interrupts off for about 30us per pixel, which
+// is time the meter ISR has to wait, so update() calls show() only when
+// a pixel has actually changed colour since the last frame.
+//
+// Each pixel has a steady colour and one entry in the animation table,
+// which can lay a pulse (the effect colour for a while) or a blink
+// (alternating effect and steady colour) over it. Animations are worked
+// out from their start time in update(), which also sets a timer for
+// when the frame will next change by itself.
+class LedStrip
+{
+  public:
+    enum Effect {LED_STEADY, LED_PULSE, LED_BLINK};
+
+    LedStrip(Adafruit_NeoPixel &strip);
+    void begin(uint8_t brightness);
+    void set(uint8_t pixel, uint32_t colour);
+    void pulse(uint8_t pixel, uint32_t colour, uint32_t duration);
+    void blink(uint8_t pixel, uint32_t colour, uint32_t period);
+    void update(uint32_t now);
+    bool nextDeadline(uint32_t &at);
+    unsigned long shows();
+
+  private:
+    struct Animation {
+      uint8_t effect;
+      uint32_t steady;
+      uint32_t colour;
+      uint32_t start;
+      uint32_t period;
+    };
+
+    uint32_t colourAt(Animation &animation, uint32_t now);
+
+    Adafruit_NeoPixel &_strip;
+    Animation _animations[LED_MAX_PIXELS];
+    uint32_t _frame[LED_MAX_PIXELS];
+    uint8_t _pixels;
+    bool _dirty;
+    Timer _timer;
+    uint32_t _now;
+    unsigned long _shows;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Ledger.h"
+#include "EventLog.h"
+
+FIRMWARE_LOCAL Ledger ledger;
+
+
+static uint16_t saturate16(uint64_t value)
+{
+  return value > 0xFFFF ? 0xFFFF : value;
+}
+
+
+Ledger::Ledger() : _clock(tick, this)
+{
+  _next = 0;
+  _count = 0;
+  _reportNext = LEDGER_SIZE;
+  _seconds = 0;
+  _millis = 0;
+}
+
+
+// Starts the uptime clock at the current time.
+void Ledger::begin()
+{
+  _millis = timers.now();
+  timers.start(_clock, LEDGER_CLOCK, LEDGER_CLOCK);
+}
+
+
+void Ledger::open(LedgerRun &run, State_type state, uint64_t milliWh)
+{
+  run.milliWh = milliWh;
+  run.started = timers.now();
+  run.start = uptime();
+  run.state = state;
+  run.open = true;
+}
+
+
+void Ledger::close(LedgerRun &run, uint8_t channel, uint64_t milliWh, int32_t baselineW, int32_t vacuumW)
+{
+  if(!run.open) {
+    return;
+  }
+  run.open = false;
+
+  // A watt for a millisecond is 1/3600 mWh.
+  uint32_t elapsed = timers.now() - run.started;
+  uint64_t used = milliWh - run.milliWh;
+  uint64_t vacuum = vacuumW > 0 ? (uint64_t)vacuumW * elapsed / 3600 : 0;
+  uint64_t idle = baselineW > 0 ? (uint64_t)baselineW * elapsed / 3600 : 0;
+  uint64_t tool = used > vacuum + idle ? used - vacuum - idle : 0;
+
+  LedgerEntry &entry = _entries[_next];
+  entry.start = run.start;
+  entry.duration = saturate16(elapsed / 1000);
+  entry.toolWh = saturate16(tool / 1000);
+  entry.vacuumWh = saturate16(vacuum / 1000);
+  entry.channel = channel << 4 | (run.state & 0x0F);
+  _next = _next + 1 < LEDGER_SIZE ? _next + 1 : 0;
+  if(_count < LEDGER_SIZE) {
+    _count++;
+  }
+  write(entry);
+}
+
+
+uint8_t Ledger::count()
+{
+  return _count;
+}
+
+
+// The index-th oldest entry.
+const LedgerEntry &Ledger::entry(uint8_t index)
+{
+  uint8_t slot = _next + LEDGER_SIZE - _count + index;
+  return _entries[slot < LEDGER_SIZE ? slot : slot - LEDGER_SIZE];
+}
+
+
+// Seconds since begin(), carried on past the millis() wrap by the
+// clock timer coming round at least once in every wrap.
+uint32_t Ledger::uptime()
+{
+  uint32_t elapsed = timers.now() - _millis;
+  _seconds += elapsed / 1000;
+  _millis += elapsed - elapsed % 1000;
+  return _seconds;
+}
+
+
+void Ledger::report()
+{
+  _reportNext = 0;
+}
+
+
+// Queues the next entry of a report, if the log has room for it.
+void Ledger::send()
+{
+  if(_reportNext >= _count || eventLog.space() < 2) {
+    return;
+  }
+  write(entry(_reportNext));
+  _reportNext++;
+}
+
+
+bool Ledger::reporting()
+{
+  return _reportNext < _count;
+}
+
+
+void Ledger::tick(void *context)
+{
+  ((Ledger *)context)->uptime();
+}
+
+
+void Ledger::write(const LedgerEntry &entry)
+{
+  eventLog.write(LOG_SESSION, entry.channel >> 4, entry.start, entry.duration);
+  eventLog.write(LOG_SESSION_ENERGY, entry.channel & 0x0F, entry.toolWh, entry.vacuumWh);
+}
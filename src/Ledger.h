@@ -0,0 +1,91 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Ledger_h
+#define Ledger_h
+
+#include <Arduino.h>
+#include "Board.h"
+#include "StateTable.h"
+#include "Timers.h"
+
+#define LEDGER_SIZE  Board::LEDGER_SIZE // Runs kept; a new one pushes out the oldest.
+#define LEDGER_CLOCK 3600000 // ms between updates of the uptime clock, well inside the millis() wrap.
+
+// One finished run, packed into eleven bytes. The energies are split
+// using the channel's learned levels: the vacuum's share is its level
+// for as long as the run went on, and the tool's is what was left over
+// the baseline. Each field stops at its largest value rather than
+// wrapping.
+struct __attribute__((packed)) LedgerEntry {
+  uint32_t start;    // Seconds since power-up.
+  uint16_t duration; // Seconds, to just over 18 hours.
+  uint16_t toolWh;
+  uint16_t vacuumWh;
+  uint8_t channel;   // The channel in the high nibble, the State_type the run began in below.
+};
+
+static_assert(sizeof(LedgerEntry) == 11, "A ledger entry is eleven bytes");
+
+// Where a channel's open run started, kept by the channel until it ends.
+struct LedgerRun {
+  uint64_t milliWh;  // The meter's total when it started.
+  uint32_t started;  // millis() when it started.
+  uint32_t start;    // And the uptime, in seconds.
+  uint8_t state;
+  bool open;
+};
+
+// The last LEDGER_SIZE runs of the vacuum over every channel, each from
+// a channel entering a state that runs it to the channel letting it go,
+// for tool use and vacuum duty cycle without logging every pulse.
+//
+// A run goes into the log as a LOG_SESSION and a LOG_SESSION_ENERGY
+// when it ends. report() sends the whole ledger again, oldest first, an
+// entry a loop while the log has room, as LoopTiming's report does.
+class Ledger
+{
+  public:
+    Ledger();
+    void begin();
+    void open(LedgerRun &run, State_type state, uint64_t milliWh);
+    void close(LedgerRun &run, uint8_t channel, uint64_t milliWh, int32_t baselineW, int32_t vacuumW);
+    uint8_t count();
+    const LedgerEntry &entry(uint8_t index);
+    uint32_t uptime();
+    void report();
+    void send();
+    bool reporting();
+
+  private:
+    static void tick(void *context);
+
+    void write(const LedgerEntry &entry);
+
+    LedgerEntry _entries[LEDGER_SIZE];
+    uint8_t _next;
+    uint8_t _count;
+    uint8_t _reportNext;
+    uint32_t _seconds;  // Uptime, as of _millis.
+    uint32_t _millis;
+    Timer _clock;
+};
+
+extern FIRMWARE_LOCAL Ledger ledger;
+
+#endif
@@ -0,0 +1,55 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef LogCatalog_h
+#define LogCatalog_h
+
+// Every message the firmware logs, in id order. New messages go on the
+// end, so that old captures still decode.
+//
+//   X(id, name, format, arguments)
+//
+// The id is all the firmware sends. The name, and with EVENT_LOG_TEXT
+// only the name, is kept in flash. The format and argument kind are
+// for host/logdecode: NUMBERS are printed as they are; STATE and STAGE
+// turn the first argument into a state or loop stage name for the %s;
+// HISTOGRAM prints the twelve byte-sized bucket counts after the format.
+#define LOG_CATALOG(X) \
+  X(LOG_STARTED,          "STARTED", "",                                      NUMBERS)   \
+  X(LOG_STATE,            "STATE",   "%s ch:%ld",                             STATE)     \
+  X(LOG_STATUS,           "STATUS",  "%s ch:%ld W:%ld",                       STATE)     \
+  X(LOG_METER_PULSES,     "METER",   "pulses:%ld overruns:%ld rejected:%ld",  NUMBERS)   \
+  X(LOG_METER_WATTS,      "WATTS",   "tick:%ld average:%ld interval:%ld",     NUMBERS)   \
+  X(LOG_DROPPED,          "DROPPED", "%ld records lost",                      NUMBERS)   \
+  X(LOG_TIMING,           "TIMING",  "%-7s max:%ldus",                        STAGE)     \
+  X(LOG_TIMING_HISTOGRAM, "BUCKETS", "<4us 4 8 16 32 64 128 256 512 1k 2k >4k:", HISTOGRAM) \
+  X(LOG_CALIBRATION,      "LEVELS",  "baseline:%ldW vacuum:%ldW tool:%ldW",   NUMBERS)   \
+  X(LOG_THRESHOLDS,       "THRESH",  "ch:%ld start:%ldW high:%ldW",           NUMBERS)   \
+  X(LOG_POWER_CHANGE,     "CHANGE",  "ch:%ld dir:%+ld level:%ldW",            NUMBERS)   \
+  X(LOG_PULSE,            "PULSE",   "ch:%ld interval:%ldus ago:%ldus",       NUMBERS)   \
+  X(LOG_POWER,            "POWER",   "ch:%ld average:%ldW interval:%ldW",     NUMBERS)   \
+  X(LOG_COUNTERS,         "COUNTS",  "ch:%ld pulses:%ld lost:%ld",            NUMBERS)   \
+  X(LOG_RESTORED,         "RESTORED", "%s ch:%ld W:%ld",                      STATE)     \
+  X(LOG_METER_SPREAD,     "SPREAD",  "min:%ldW max:%ldW deviation:%ldW",      NUMBERS)   \
+  X(LOG_SESSION,          "SESSION", "ch:%ld start:%lds duration:%lds",       NUMBERS)   \
+  X(LOG_SESSION_ENERGY,   "ENERGY",  "%s tool:%ldWh vacuum:%ldWh",            STATE)     \
+  X(LOG_ARCHIVE,          "ARCHIVE", "level:%ld #%ld pulses:%ld",             NUMBERS)   \
+  X(LOG_ARCHIVE_WATTS,    "RANGE",   "mean:%ldW min:%ldW max:%ldW",           NUMBERS)   \
+  X(LOG_ARCHIVE_RAW,      "RAW",     "%ldus %ldus %ldus",                     NUMBERS)
+
+#endif
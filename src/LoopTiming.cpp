@@ -0,0 +1,122 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "LoopTiming.h"
+
+#ifdef LOOP_TIMING
+
+#include "EventLog.h"
+
+static_assert(LOOP_TIMING_BUCKETS == 12, "The histogram is sent as three 32-bit log arguments");
+
+FIRMWARE_LOCAL LoopTiming loopTiming;
+
+
+LoopTiming::LoopTiming()
+{
+  clear();
+  _reportNext = STAGE_COUNT;
+  _loopStarted = 0;
+  _stageStarted = 0;
+}
+
+
+void LoopTiming::start()
+{
+  _loopStarted = micros();
+  _stageStarted = _loopStarted;
+}
+
+
+// Ends the given stage, and starts the next one.
+void LoopTiming::mark(LoopStage stage)
+{
+  uint32_t now = micros();
+  record(stage, now - _stageStarted);
+  _stageStarted = now;
+}
+
+
+void LoopTiming::end()
+{
+  record(STAGE_LOOP, micros() - _loopStarted);
+}
+
+
+void LoopTiming::clear()
+{
+  for(uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+    for(uint8_t i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+      _buckets[stage][i] = 0;
+    }
+    _max[stage] = 0;
+  }
+}
+
+
+void LoopTiming::report()
+{
+  _reportNext = 0;
+}
+
+
+// Queues the next stage of a report, if the log has room for it.
+void LoopTiming::send()
+{
+  if(_reportNext >= STAGE_COUNT || eventLog.space() < 2) {
+    return;
+  }
+
+  const uint8_t *b = _buckets[_reportNext];
+  int32_t packed[3];
+  for(uint8_t i = 0; i < 3; i++) {
+    packed[i] = (uint32_t)b[4*i] | (uint32_t)b[4*i + 1] << 8 | (uint32_t)b[4*i + 2] << 16 | (uint32_t)b[4*i + 3] << 24;
+  }
+  eventLog.write(LOG_TIMING, _reportNext, _max[_reportNext]);
+  eventLog.write(LOG_TIMING_HISTOGRAM, packed[0], packed[1], packed[2]);
+  _reportNext++;
+}
+
+
+bool LoopTiming::reporting()
+{
+  return _reportNext < STAGE_COUNT;
+}
+
+
+void LoopTiming::record(uint8_t stage, uint32_t elapsed)
+{
+  if(elapsed > _max[stage]) {
+    _max[stage] = elapsed;
+  }
+
+  uint8_t bucket = 0;
+  for(uint32_t quanta = elapsed >> 2; quanta != 0 && bucket < LOOP_TIMING_BUCKETS - 1; quanta >>= 1) {
+    bucket++;
+  }
+
+  uint8_t *buckets = _buckets[stage];
+  if(buckets[bucket] == 255) {
+    for(uint8_t i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+      buckets[i] >>= 1;
+    }
+  }
+  buckets[bucket]++;
+}
+
+#endif
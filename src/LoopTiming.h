@@ -0,0 +1,99 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef LoopTiming_h
+#define LoopTiming_h
+
+#include <Arduino.h>
+#include "Board.h"
+
+// #define LOOP_TIMING 1 // Time the stages of loop(); or build with -DLOOP_TIMING.
+
+#define LOOP_TIMING_BUCKETS 12
+
+// The parts of loop() that are timed, in the order they run.
+enum LoopStage {
+  STAGE_INPUTS = 0, // Debouncing the switches
+  STAGE_METER,      // Collecting pulses and working out the power
+  STAGE_STATE,      // Posting and dispatching state machine events
+  STAGE_LEDS,       // Composing and sending the LED frame
+  STAGE_SERIAL,     // Sending the log and reading commands
+  STAGE_LOOP,       // The whole pass, not counting sleep
+  STAGE_COUNT
+};
+
+#ifdef LOOP_TIMING
+
+// Per-stage loop() timings, kept on the device.
+//
+// Each stage has a histogram of how long it took, in log2 buckets of
+// micros(): bucket 0 is anything under 4us (the resolution of micros()
+// at 16MHz), bucket n covers 2^(n+1) to 2^(n+2)-1 us, and the last bucket
+// takes everything longer. The counts are bytes; when one would
+// overflow, all of that stage's buckets are halved, which keeps the
+// shape of the histogram. The longest time seen is kept exactly.
+//
+// report() queues each stage as two event log records (LOG_TIMING and
+// LOG_TIMING_HISTOGRAM), a stage at a time as the log has room.
+class LoopTiming
+{
+  public:
+    LoopTiming();
+    void start();
+    void mark(LoopStage stage);
+    void end();
+    void clear();
+    void report();
+    void send();
+    bool reporting();
+
+  private:
+    void record(uint8_t stage, uint32_t elapsed);
+
+    uint8_t _buckets[STAGE_COUNT][LOOP_TIMING_BUCKETS];
+    uint32_t _max[STAGE_COUNT];
+    uint32_t _loopStarted;
+    uint32_t _stageStarted;
+    uint8_t _reportNext;
+};
+
+extern FIRMWARE_LOCAL LoopTiming loopTiming;
+
+#define LOOP_TIMING_START()      loopTiming.start()
+#define LOOP_TIMING_MARK(stage)  loopTiming.mark(stage)
+#define LOOP_TIMING_END()        loopTiming.end()
+#define LOOP_TIMING_CLEAR()      loopTiming.clear()
+#define LOOP_TIMING_REPORT()     loopTiming.report()
+#define LOOP_TIMING_SEND()       loopTiming.send()
+#define LOOP_TIMING_REPORTING()  loopTiming.reporting()
+#define LOOP_TIMING_RAM          sizeof(LoopTiming)
+
+#else
+
+#define LOOP_TIMING_START()      do {} while(0)
+#define LOOP_TIMING_MARK(stage)  do {} while(0)
+#define LOOP_TIMING_END()        do {} while(0)
+#define LOOP_TIMING_CLEAR()      do {} while(0)
+#define LOOP_TIMING_REPORT()     do {} while(0)
+#define LOOP_TIMING_SEND()       do {} while(0)
+#define LOOP_TIMING_REPORTING()  false
+#define LOOP_TIMING_RAM          0
+
+#endif
+
+#endif
@@ -0,0 +1,273 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "PowerArchive.h"
+
+#ifdef POWER_ARCHIVE
+#include "EventLog.h"
+
+#define ARCHIVE_SAMPLES_PER_SECOND (1000 / ARCHIVE_SAMPLE)
+
+static_assert(1000 % ARCHIVE_SAMPLE == 0, "A second must hold a whole number of samples");
+
+FIRMWARE_LOCAL PowerArchive powerArchive;
+
+
+static uint16_t clip16(uint32_t value)
+{
+  return value > 0xFFFF ? 0xFFFF : value;
+}
+
+
+void PowerArchive::Accumulator::clear()
+{
+  pulses = 0;
+  sum = 0;
+  samples = 0;
+  minW = 0xFFFF;
+  maxW = 0;
+}
+
+
+void PowerArchive::Accumulator::add(uint32_t pulses, uint16_t meanW, uint16_t minW, uint16_t maxW)
+{
+  this->pulses += pulses;
+  sum += meanW;
+  samples++;
+  if(minW < this->minW) {
+    this->minW = minW;
+  }
+  if(maxW > this->maxW) {
+    this->maxW = maxW;
+  }
+}
+
+
+ArchiveEntry PowerArchive::Accumulator::entry() const
+{
+  ArchiveEntry entry;
+  entry.pulses = clip16(pulses);
+  entry.meanW = samples ? (sum + samples / 2) / samples : 0;
+  entry.minW = samples ? minW : 0;
+  entry.maxW = maxW;
+  return entry;
+}
+
+
+PowerArchive::PowerArchive() : _timer(due, this)
+{
+  _meter = NULL;
+  _rawTail = 0;
+  _rawUsed = 0;
+  _rawBase = 0;
+  _rawLast = 0;
+  _second.clear();
+  _minute.clear();
+  _hour.clear();
+  _seconds.added = 0;
+  _minutes.added = 0;
+  _hours.added = 0;
+  _reportLevel = ARCHIVE_LEVELS;
+  _reportNext = 0;
+  _reportValue = 0;
+}
+
+
+void PowerArchive::begin(PowerMeter &meter)
+{
+  _meter = &meter;
+  timers.start(_timer, ARCHIVE_SAMPLE, ARCHIVE_SAMPLE);
+}
+
+
+// Keeps the interval, in microseconds, of each of the channel's pulses.
+void PowerArchive::pulse(uint8_t channel, uint32_t interval)
+{
+  if(channel != ARCHIVE_CHANNEL || _meter == NULL) {
+    return;
+  }
+  _second.pulses++;
+
+  int32_t delta = interval - _rawLast;
+  uint32_t zigzag = (uint32_t)delta << 1 ^ (uint32_t)(delta >> 31);
+  uint8_t bytes[5];
+  uint8_t n = 0;
+  do {
+    bytes[n] = zigzag & 0x7F;
+    zigzag >>= 7;
+    if(zigzag != 0) {
+      bytes[n] |= 0x80;
+    }
+    n++;
+  } while(zigzag != 0);
+
+  while(ARCHIVE_RAW_BYTES - _rawUsed < n) {
+    dropRaw();
+  }
+  for(uint8_t i = 0; i < n; i++) {
+    _raw[(_rawTail + _rawUsed) % ARCHIVE_RAW_BYTES] = bytes[i];
+    _rawUsed++;
+  }
+  _rawLast = interval;
+}
+
+
+void PowerArchive::report(ArchiveLevel level)
+{
+  _reportLevel = level;
+  _reportValue = _rawBase;
+  switch(level) {
+    case ARCHIVE_SECOND: _reportNext = _seconds.oldest(); break;
+    case ARCHIVE_MINUTE: _reportNext = _minutes.oldest(); break;
+    case ARCHIVE_HOUR:   _reportNext = _hours.oldest(); break;
+    default:             _reportNext = 0; break;
+  }
+}
+
+
+// Queues the next entry of a report, if the log has room for it.
+void PowerArchive::send()
+{
+  if(_reportLevel == ARCHIVE_LEVELS || eventLog.space() < 2) {
+    return;
+  }
+  switch(_reportLevel) {
+    case ARCHIVE_RAW:    sendRaw(); break;
+    case ARCHIVE_SECOND: sendRing(ARCHIVE_SECOND, _seconds); break;
+    case ARCHIVE_MINUTE: sendRing(ARCHIVE_MINUTE, _minutes); break;
+    case ARCHIVE_HOUR:   sendRing(ARCHIVE_HOUR, _hours); break;
+    default:             _reportLevel = ARCHIVE_LEVELS; break;
+  }
+}
+
+
+bool PowerArchive::reporting()
+{
+  return _reportLevel != ARCHIVE_LEVELS;
+}
+
+
+void PowerArchive::due(void *context)
+{
+  ((PowerArchive *)context)->sample();
+}
+
+
+// Adds a sample to the second, and rolls each level up into the next as
+// it fills.
+void PowerArchive::sample()
+{
+  uint16_t watts = clip16(_meter->intervalW());
+  _second.add(0, watts, watts, watts);
+  if(_second.samples < ARCHIVE_SAMPLES_PER_SECOND) {
+    return;
+  }
+
+  ArchiveEntry entry = _second.entry();
+  _seconds.add(entry);
+  _minute.add(_second.pulses, entry.meanW, entry.minW, entry.maxW);
+  _second.clear();
+  if(_minute.samples < 60) {
+    return;
+  }
+
+  entry = _minute.entry();
+  _minutes.add(entry);
+  _hour.add(_minute.pulses, entry.meanW, entry.minW, entry.maxW);
+  _minute.clear();
+  if(_hour.samples < 60) {
+    return;
+  }
+
+  _hours.add(_hour.entry());
+  _hour.clear();
+}
+
+
+// Makes room by letting the oldest interval go, keeping a report of the
+// raw ring in step with the bytes that are left.
+void PowerArchive::dropRaw()
+{
+  uint16_t offset = 0;
+  _rawBase += readRaw(offset);
+  _rawTail = (_rawTail + offset) % ARCHIVE_RAW_BYTES;
+  _rawUsed -= offset;
+  if(_reportLevel == ARCHIVE_RAW) {
+    if(_reportNext >= offset) {
+      _reportNext -= offset;
+    } else {
+      _reportNext = 0;
+      _reportValue = _rawBase;
+    }
+  }
+}
+
+
+// The difference stored offset bytes from the oldest, moving offset on
+// past it.
+int32_t PowerArchive::readRaw(uint16_t &offset)
+{
+  uint32_t zigzag = 0;
+  uint8_t shift = 0;
+  uint8_t b;
+  do {
+    b = _raw[(_rawTail + offset) % ARCHIVE_RAW_BYTES];
+    offset++;
+    zigzag |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while((b & 0x80) && offset < _rawUsed);
+  return (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+}
+
+
+void PowerArchive::sendRaw()
+{
+  if(_reportNext >= _rawUsed) {
+    _reportLevel = ARCHIVE_LEVELS;
+    return;
+  }
+  int32_t intervals[3] = { -1, -1, -1 };
+  for(uint8_t i = 0; i < 3 && _reportNext < _rawUsed; i++) {
+    uint16_t offset = _reportNext;
+    _reportValue += readRaw(offset);
+    _reportNext = offset;
+    intervals[i] = _reportValue;
+  }
+  eventLog.write(LOG_ARCHIVE_RAW, intervals[0], intervals[1], intervals[2]);
+}
+
+
+// Entries that have gone round the ring since the report began are
+// skipped.
+template <uint8_t N>
+void PowerArchive::sendRing(uint8_t level, const ArchiveRing<N> &ring)
+{
+  if(_reportNext < ring.oldest()) {
+    _reportNext = ring.oldest();
+  }
+  if(_reportNext >= ring.added) {
+    _reportLevel = ARCHIVE_LEVELS;
+    return;
+  }
+  const ArchiveEntry &entry = ring.at(_reportNext);
+  eventLog.write(LOG_ARCHIVE, level, _reportNext, entry.pulses);
+  eventLog.write(LOG_ARCHIVE_WATTS, entry.meanW, entry.minW, entry.maxW);
+  _reportNext++;
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef PowerArchive_h
+#define PowerArchive_h
+
+#include <Arduino.h>
+#include "Board.h"
+#include "PowerMeter.h"
+#include "Timers.h"
+
+// #define POWER_ARCHIVE 1 // Keep a history of one channel's power; or build with -DPOWER_ARCHIVE, as the mega env does.
+
+#define ARCHIVE_CHANNEL   0    // The channel whose power is kept.
+#define ARCHIVE_SAMPLE    250  // ms between samples of the meter's intervalW().
+#define ARCHIVE_RAW_BYTES Board::ARCHIVE_RAW_BYTES // Pulse intervals, a byte or two each while the load is steady.
+#define ARCHIVE_SECONDS   Board::ARCHIVE_SECONDS   // Entries kept at each level; on a Mega two minutes,
+#define ARCHIVE_MINUTES   Board::ARCHIVE_MINUTES   // two hours,
+#define ARCHIVE_HOURS     Board::ARCHIVE_HOURS     // and four days.
+
+// The levels, for report().
+enum ArchiveLevel {
+  ARCHIVE_RAW,
+  ARCHIVE_SECOND,
+  ARCHIVE_MINUTE,
+  ARCHIVE_HOUR,
+  ARCHIVE_LEVELS
+};
+
+#ifdef POWER_ARCHIVE
+
+// One period at one level, with the powers clipped to 16 bits.
+struct ArchiveEntry {
+  uint16_t pulses;
+  uint16_t meanW;
+  uint16_t minW;
+  uint16_t maxW;
+};
+
+// A fixed-size ring of one level's entries. Entries are numbered from
+// the first ever added, so that one at the start of a second is that
+// many seconds since begin().
+template <uint8_t N>
+struct ArchiveRing {
+  ArchiveEntry entries[N];
+  uint32_t added;
+
+  void add(const ArchiveEntry &entry) { entries[added % N] = entry; added++; }
+  uint32_t oldest() const { return added > N ? added - N : 0; }
+  const ArchiveEntry &at(uint32_t number) const { return entries[number % N]; }
+};
+
+// A round-robin history of one channel's power, for looking back at what
+// led up to a false start or a missed one without a host logging all
+// the while.
+//
+// The newest pulse intervals are kept as they came, each as the zigzag
+// varint of its difference from the one before, in a byte ring that
+// drops the oldest to make room. Every ARCHIVE_SAMPLE the meter's
+// intervalW() is sampled, and each second the samples and the pulses
+// counted in it go into a seconds ring as a count, mean, minimum and
+// maximum. Sixty seconds roll up into a minute the same way, and sixty
+// minutes into an hour.
+//
+// report() sends one level through the event log, oldest first, an
+// entry a loop while the log has room: each period as an ARCHIVE and a
+// RANGE record, and the raw intervals three to a RAW record. A raw
+// interval is 0 for the first pulse after a gap, and -1 fills out the
+// last record.
+class PowerArchive
+{
+  public:
+    PowerArchive();
+    void begin(PowerMeter &meter);
+    void pulse(uint8_t channel, uint32_t interval);
+    void report(ArchiveLevel level);
+    void send();
+    bool reporting();
+
+  private:
+    // A period at some level that is still going.
+    struct Accumulator {
+      uint32_t pulses;
+      uint32_t sum;
+      uint8_t samples;
+      uint16_t minW;
+      uint16_t maxW;
+
+      void clear();
+      void add(uint32_t pulses, uint16_t meanW, uint16_t minW, uint16_t maxW);
+      ArchiveEntry entry() const;
+    };
+
+    static void due(void *context);
+    void sample();
+    void dropRaw();
+    int32_t readRaw(uint16_t &offset);
+    void sendRaw();
+    template <uint8_t N> void sendRing(uint8_t level, const ArchiveRing<N> &ring);
+
+    PowerMeter *_meter;
+    Timer _timer;
+
+    uint8_t _raw[ARCHIVE_RAW_BYTES];
+    uint16_t _rawTail;
+    uint16_t _rawUsed;
+    uint32_t _rawBase;  // The interval before the oldest one kept.
+    uint32_t _rawLast;  // The newest.
+
+    Accumulator _second;
+    Accumulator _minute;
+    Accumulator _hour;
+    ArchiveRing<ARCHIVE_SECONDS> _seconds;
+    ArchiveRing<ARCHIVE_MINUTES> _minutes;
+    ArchiveRing<ARCHIVE_HOURS> _hours;
+
+    ArchiveLevel _reportLevel;
+    uint32_t _reportNext;   // The entry number, or raw byte from the oldest, to send next.
+    uint32_t _reportValue;  // The raw interval before it.
+};
+
+extern FIRMWARE_LOCAL PowerArchive powerArchive;
+
+#define ARCHIVE_BEGIN(meter)              powerArchive.begin(meter)
+#define ARCHIVE_PULSE(channel, interval)  powerArchive.pulse(channel, interval)
+#define ARCHIVE_REPORT(level)             powerArchive.report(level)
+#define ARCHIVE_SEND()                    powerArchive.send()
+#define ARCHIVE_REPORTING()               powerArchive.reporting()
+#define ARCHIVE_RAM                       sizeof(PowerArchive)
+
+#else
+
+#define ARCHIVE_BEGIN(meter)              do {} while(0)
+#define ARCHIVE_PULSE(channel, interval)  do {} while(0)
+#define ARCHIVE_REPORT(level)             do {} while(0)
+#define ARCHIVE_SEND()                    do {} while(0)
+#define ARCHIVE_REPORTING()               false
+#define ARCHIVE_RAM                       0
+
+#endif
+
+#endif
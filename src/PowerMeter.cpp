@@ -18,91 +18,216 @@
 
 #include "PowerMeter.h"
 #include "Arduino.h"
-#include "RunningAverage.h"
-#include <Bounce2.h>
+#include "Debouncer.h"
 
-#define DEBUG_POWERMETER 1
+// #define DEBUG_POWERMETER 1 // Log the meter statistics every AVG_FREQ.
 
-#define WH_PER_PULSE 0.5  // The meter pulses 2,000 per kWh (0.5Wh/imp).
-#define AVG_FREQ     250  // ms between stats updates
-#define AVG_WINDOW   5000 // Milliseconds of sliding average window.
+#ifdef DEBUG_POWERMETER
+#include "EventLog.h"
+#endif
+
+#define MILLIWH_PER_PULSE 500 // The meter pulses 2,000 per kWh (0.5Wh/imp).
+#define WH_PER_PULSE (MILLIWH_PER_PULSE / 1000.0)
 #define MS_PER_HOUR  3600000
-#define WATT_WINDOW  5000 // Milliseconds of sliding average window for the Watt counter
+#define MIN_PULSE_INTERVAL 50000UL // Microseconds; anything closer is bounce (it would mean over 36kW).
+#define MAX_PULSE_INTERVAL 600000000UL // Microseconds; a longer gap reads as no load, and keeps micros() from wrapping.
+#define WATT_US_PER_PULSE (WH_PER_PULSE * MS_PER_HOUR * 1000.0) // One pulse per microsecond, in Watts.
+
+const Q8 WH_PER_PULSE_Q8 = Q8::fromFloat(WH_PER_PULSE);
+const long WATT_MS_PER_PULSE = (long)(WH_PER_PULSE * MS_PER_HOUR); // One pulse per millisecond, in Watts.
+
+const PowerMeter::Isr PowerMeter::ISR_SLOTS[METER_ISR_SLOTS] = {
+  isr<0>, isr<1>, isr<2>, isr<3>, isr<4>, isr<5>, isr<6>, isr<7>
+};
+static_assert(METER_ISR_SLOTS == 8, "ISR_SLOTS lists one trampoline per slot");
 
-RunningAverage whPerTick(AVG_WINDOW/AVG_FREQ);
-RunningAverage wattsAverage(WATT_WINDOW/AVG_FREQ);
+FIRMWARE_LOCAL PowerMeter *PowerMeter::_isrMeters[METER_ISR_SLOTS];
 
 
-PowerMeter::PowerMeter()
+PowerMeter::PowerMeter() : _statsTimer(statsDue, this)
 {
-  _sensor = Bounce();
-  _timeSinceLastPulse = 0;
+  _input = -1;
+  _mode = PULSE_POLLED;
+  _pin = -1;
+  _pulseInterval = 0;
   _lastPulseTime = 0;
-  _totalWhSeen = 0;
+  _lastPulseValid = false;
+  _estimator = ESTIMATE_AVERAGE;
   _totalPulses = 0;
+  _lastStatsUpdate = 0;
+  _statsDue = false;
+  _lastUpdatePulses = 0;
+  _maxPulseLatency = 0;
   _pulseThisFrame = false;
-  whPerTick.fillValue(0, whPerTick.getSize());
-  wattsAverage.fillValue(0, wattsAverage.getSize());
+  _lastCapture = 0;
+  _captured = false;
+  _rejected = 0;
+  _overrunMark = 0;
+  _rejectedMark = 0;
+  _overruns = 0;
+  _rejectedTotal = 0;
+  _change = ChangeDetector::CHANGE_NONE;
+  _clamp = NULL;
+  _whPerTick.fillValue(0, _whPerTick.getSize());
+  _wattsAverage.fillValue(0, _wattsAverage.getSize());
 }
 
 
-void PowerMeter::attach(int pin)
+// Frees the meter's ISR slot or debouncer input, for meters that don't
+// live for ever.
+PowerMeter::~PowerMeter()
+{
+        inputs.detach(_input);
+        for(uint8_t slot = 0; slot < METER_ISR_SLOTS; slot++) {
+                if(_isrMeters[slot] == this) {
+                        detachInterrupt(digitalPinToInterrupt(_pin));
+                        _isrMeters[slot] = NULL;
+                }
+        }
+}
+
+
+void PowerMeter::attach(int pin, PulseMode mode)
 {
         _pin = pin;
+        _mode = mode;
         if(_pin != -1)
         {
-                Serial.println("Attaching to meter");
                 pinMode(_pin, INPUT_PULLUP);
-                _sensor.attach(_pin);
-              	_sensor.interval(25);
+                if(_mode == PULSE_INTERRUPT && digitalPinToInterrupt(_pin) != NOT_AN_INTERRUPT)
+                {
+                        uint8_t slot = 0;
+                        while(slot < METER_ISR_SLOTS && _isrMeters[slot] != NULL && _isrMeters[slot] != this) {
+                                slot++;
+                        }
+                        if(slot == METER_ISR_SLOTS) {
+                                _mode = PULSE_POLLED;
+                        } else {
+                                // The meter counts on the rising edge, as the polled mode does.
+                                _isrMeters[slot] = this;
+                                attachInterrupt(digitalPinToInterrupt(_pin), ISR_SLOTS[slot], RISING);
+                        }
+                }
+                else
+                {
+                        _mode = PULSE_POLLED;
+                }
+                if(_mode == PULSE_POLLED)
+                {
+                        _input = inputs.attach(_pin);
+                }
+        }
+        _whPerTick.clear();
+        _wattsAverage.clear();
+        _lastStatsUpdate = timers.now();
+        timers.start(_statsTimer, AVG_FREQ, AVG_FREQ);
+}
+
+
+// Whether the pin is sampled from update(). The loop has to watch a
+// polled pin to wake when it moves; the debouncer then samples it only
+// until it settles.
+bool PowerMeter::polled()
+{
+        return _mode == PULSE_POLLED && _pin != -1;
+}
+
+
+// Adds a CT clamp on the same circuit, which update() keeps up to date
+// and ESTIMATE_CURRENT reads. NULL takes it away again.
+void PowerMeter::clamp(CurrentSensor *clamp)
+{
+        _clamp = clamp;
+        if(_clamp != NULL) {
+                _clamp->begin();
         }
-        whPerTick.clear();
-        wattsAverage.clear();
+}
+
+
+CurrentSensor *PowerMeter::clamp()
+{
+        return _clamp;
+}
+
+
+// Carries on from where a snapshot left off: the pulse count, the change
+// detector's level, and both averaging windows full of the power they
+// last showed, so that watts() is right from the first tick instead of
+// once the windows have filled again. Call it after attach().
+void PowerMeter::restore(uint64_t pulses, int32_t watts, int32_t level)
+{
+        _totalPulses = pulses;
+        _lastUpdatePulses = pulses;
+        _whPerTick.fillValue(Q8::fromRaw((int64_t)watts * AVG_FREQ * Q8::ONE / MS_PER_HOUR), _whPerTick.getSize());
+        _wattsAverage.fillValue(watts, _wattsAverage.getSize());
+        _detector.reset(level);
 }
 
 
 void PowerMeter::update()
 {
-  _sensor.update();
+  if(_clamp != NULL) {
+    _clamp->update();
+  }
 
-  if(_sensor.rose()) {
-    pulse();
+  if(inputs.rose(_input)) {
+    capture(micros());
   }
 
+  uint32_t timestamp;
+  bool pulsed = false;
+  while(_pulses.pop(timestamp)) {
+    pulsed = true;
+    uint32_t latency = micros() - timestamp;
+    if(latency > _maxPulseLatency) {
+      _maxPulseLatency = latency;
+    }
+    recordPulse(timestamp);
+  }
 
-  static long lastStatsUpdate = millis();
-  static float lastUpdateWh;
-  if(millis() - lastStatsUpdate > AVG_FREQ)
-  {
-    long frameTime = millis() - lastStatsUpdate;
+  uint8_t overrunCount = _pulses.overruns();
+  _overruns += (uint8_t)(overrunCount - _overrunMark);
+  _overrunMark = overrunCount;
+  uint8_t rejectedCount = _rejected;
+  _rejectedTotal += (uint8_t)(rejectedCount - _rejectedMark);
+  _rejectedMark = rejectedCount;
 
-    #ifdef DEBUG_POWERMETER
-    Serial.print("pulses:"); Serial.print(_totalPulses); Serial.print("\t");
-    Serial.print("totalWh:"); Serial.print(totalWh()); Serial.print("\t");
-    Serial.print("lastWh:"); Serial.print(lastUpdateWh); Serial.print("\t");
-    #endif
+  if(_lastPulseValid && micros() - _lastPulseTime > MAX_PULSE_INTERVAL) {
+    _lastPulseValid = false;
+    _pulseInterval = 0;
+  }
 
-    float whSinceLastTick = totalWh() - lastUpdateWh;
-    whPerTick.addValue(whSinceLastTick);
-    #ifdef DEBUG_POWERMETER
-    Serial.print("whSinceLastTick:"); Serial.print(whSinceLastTick); Serial.print("\t");
-    Serial.print("whPerTick.AVG:"); Serial.print(whPerTick.getAverage(), 4); Serial.print("\t");
-    #endif
 
-    float deltaHours = (float)frameTime / MS_PER_HOUR;
-    float wPerTick = whSinceLastTick / deltaHours;
-    #ifdef DEBUG_POWERMETER
-    Serial.print("wPerTick:"); Serial.print(wPerTick, 0); Serial.print("\t");
-    #endif
-    wattsAverage.addValue(wPerTick);
+  // The detector sees each new pulse interval as it arrives, and the
+  // decaying bound on intervalW() every stats tick in between.
+  bool tick = _statsDue;
+  if(pulsed || tick) {
+    ChangeDetector::Change change = _detector.add(intervalW());
+    if(change != ChangeDetector::CHANGE_NONE) {
+      _change = change;
+    }
+  }
+
+  if(tick)
+  {
+    long frameTime = timers.now() - _lastStatsUpdate;
+    long pulsesSinceLastTick = (long)(_totalPulses - _lastUpdatePulses);
+
+    Q8 whSinceLastTick = WH_PER_PULSE_Q8 * pulsesSinceLastTick;
+    _whPerTick.addValue(whSinceLastTick);
+
+    int32_t wPerTick = (pulsesSinceLastTick * WATT_MS_PER_PULSE + frameTime / 2) / frameTime;
+    _wattsAverage.addValue(wPerTick);
 
     #ifdef DEBUG_POWERMETER
-    Serial.print("wPerTick.AVG:"); Serial.print(wattsAverage.getAverage(), 0); Serial.print("\t");
-    Serial.println();
+    eventLog.write(LOG_METER_PULSES, (int32_t)_totalPulses, _overruns, _rejectedTotal);
+    eventLog.write(LOG_METER_WATTS, wPerTick, _wattsAverage.getAverage(), (int32_t)intervalW());
+    eventLog.write(LOG_METER_SPREAD, minimumW(), maximumW(), (int32_t)deviationW());
     #endif
 
-    lastUpdateWh = totalWh();
-    lastStatsUpdate = millis();
+    _lastUpdatePulses = _totalPulses;
+    _lastStatsUpdate = timers.now();
+    _statsDue = false;
   }
 
 }
@@ -119,29 +244,213 @@ bool PowerMeter::pulseSeen()
 }
 
 
+// Microseconds between the last two pulses; 0 for the first pulse, and
+// the first after a long enough gap that the load is taken as off.
+uint32_t PowerMeter::pulseInterval()
+{
+        return _pulseInterval;
+}
+
+
+// micros() at the last pulse's edge, as it was captured.
+uint32_t PowerMeter::pulseTime()
+{
+        return _lastPulseTime;
+}
+
+
+// Every pulse counted, which 64 bits can count for as long as the meter
+// will last.
+uint64_t PowerMeter::pulses()
+{
+        return _totalPulses;
+}
+
+
 float PowerMeter::averageWh()
 {
-        return max(0, whPerTick.getAverage());
+        return max(0, _whPerTick.getAverage().toFloat());
 }
 
 
 float PowerMeter::averageW()
 {
-        return max(0, wattsAverage.getAverage());
+        return max(0, (float)_wattsAverage.getAverage());
+}
+
+
+// How much the power has varied over the averageW() window: its standard
+// deviation, and the lowest and highest stats tick in it. A steady load
+// and a noisy one can have the same average; these tell them apart.
+float PowerMeter::deviationW()
+{
+        return _wattsAverage.getDeviation();
+}
+
+
+int32_t PowerMeter::minimumW()
+{
+        return _wattsAverage.getMinimum();
 }
 
 
-float PowerMeter::totalWh()
+int32_t PowerMeter::maximumW()
 {
-        return max(0, _totalWhSeen);
+        return _wattsAverage.getMaximum();
+}
+
+
+// Instantaneous power from the gap between the last two pulses. While
+// no new pulse arrives the load can be at most one pulse per time
+// elapsed since the last one, so the estimate decays towards that bound
+// instead of holding the old value until the next pulse.
+float PowerMeter::intervalW()
+{
+        if(_pulseInterval == 0) {
+                return 0;
+        }
+        uint32_t interval = max(_pulseInterval, micros() - _lastPulseTime);
+        return WATT_US_PER_PULSE / interval;
+}
+
+
+float PowerMeter::watts()
+{
+        if(_estimator == ESTIMATE_INTERVAL) {
+                return intervalW();
+        }
+        if(_estimator == ESTIMATE_CHANGE) {
+                return _detector.level();
+        }
+        if(_estimator == ESTIMATE_CURRENT && _clamp != NULL) {
+                return _clamp->averageW();
+        }
+        return averageW();
+}
+
+
+// The averaged figure from the same source as watts(): averageW() for
+// the pulse estimators, and the clamp's own average for ESTIMATE_CURRENT.
+// For learning levels from, where one quick swing shouldn't count.
+float PowerMeter::steadyW()
+{
+        if(_estimator == ESTIMATE_CURRENT && _clamp != NULL) {
+                return _clamp->averageW();
+        }
+        return averageW();
+}
+
+
+void PowerMeter::estimator(Estimator estimator)
+{
+        _estimator = estimator;
+}
+
+
+// The last step the change detector called, once; CHANGE_NONE if
+// there hasn't been one since the last call.
+ChangeDetector::Change PowerMeter::change()
+{
+        ChangeDetector::Change change = _change;
+        _change = ChangeDetector::CHANGE_NONE;
+        return change;
+}
+
+
+// For tuning the detector's drift and threshold.
+ChangeDetector &PowerMeter::detector()
+{
+        return _detector;
+}
+
+
+// The energy the pulses add up to, worked out from the count each time
+// rather than summed, so it never rounds or stops going up.
+uint64_t PowerMeter::totalMilliWh()
+{
+        return _totalPulses * MILLIWH_PER_PULSE;
+}
+
+
+uint64_t PowerMeter::totalWh()
+{
+        return totalMilliWh() / 1000;
+}
+
+
+Q8 PowerMeter::totalKWh()
+{
+        return Q8::fromRaw((int32_t)(totalMilliWh() * Q8::ONE / 1000000));
+}
+
+
+// True while pulses, or a clamp's mains cycle, are waiting for update()
+// to collect them.
+bool PowerMeter::pending()
+{
+        return !_pulses.empty() || (_clamp != NULL && _clamp->pending());
+}
+
+
+// Longest time, in micros, a pulse waited between capture and update().
+unsigned long PowerMeter::maxPulseLatency()
+{
+        return _maxPulseLatency;
+}
+
+
+unsigned long PowerMeter::overruns()
+{
+        return _overruns;
+}
+
+
+unsigned long PowerMeter::rejectedPulses()
+{
+        return _rejectedTotal;
+}
+
+
+void PowerMeter::statsDue(void *context)
+{
+        ((PowerMeter *)context)->_statsDue = true;
 }
 
 
 void PowerMeter::pulse()
+{
+        recordPulse(micros());
+}
+
+
+template<uint8_t SLOT> void PowerMeter::isr()
+{
+        if(_isrMeters[SLOT] != NULL) {
+                _isrMeters[SLOT]->capture(micros());
+        }
+}
+
+
+// Runs in the ISR in PULSE_INTERRUPT mode, or from update() when polled.
+// Edges closer together than MIN_PULSE_INTERVAL can't be real pulses,
+// so they are dropped here before they can fill the buffer.
+void PowerMeter::capture(uint32_t timestamp)
+{
+        if(_captured && timestamp - _lastCapture < MIN_PULSE_INTERVAL) {
+                _rejected++;
+                return;
+        }
+        _captured = true;
+        _lastCapture = timestamp;
+        _pulses.push(timestamp);
+}
+
+
+void PowerMeter::recordPulse(uint32_t timestamp)
 {
         _totalPulses++;
-        _timeSinceLastPulse = millis() - _lastPulseTime;
-        _totalWhSeen += WH_PER_PULSE;
-        _lastPulseTime = millis();
+        _pulseInterval = _lastPulseValid ? timestamp - _lastPulseTime : 0;
+        _lastPulseTime = timestamp;
+        _lastPulseValid = true;
         _pulseThisFrame = true;
 }
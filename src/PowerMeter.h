@@ -18,28 +18,131 @@
 
 #ifndef PowerMeter_h
 #define PowerMeter_h
-#include <Bounce2.h>
+#include "Board.h"
+#include "ChangeDetector.h"
+#include "CurrentSensor.h"
+#include "Fixed.h"
+#include "PulseBuffer.h"
+#include "RunningAverage.h"
+#include "Timers.h"
+#include "WindowStats.h"
+
+#define PULSE_BUFFER_SIZE 16  // Pulses that can queue up between two calls to update().
+#define METER_ISR_SLOTS   8   // Meters that can count in PULSE_INTERRUPT mode at once; the rest are polled.
+
+// The stats period and windows can be set with build flags, for tuning
+// them on the host; see host/tune.
+#ifndef AVG_FREQ
+#define AVG_FREQ          250  // ms between stats updates
+#endif
+#ifndef AVG_WINDOW
+#define AVG_WINDOW        Board::AVG_WINDOW_MS  // Milliseconds of sliding average window.
+#endif
+#ifndef WATT_WINDOW
+#define WATT_WINDOW       Board::WATT_WINDOW_MS // Milliseconds of sliding average window for the Watt counter
+#endif
+
+static_assert(AVG_WINDOW % AVG_FREQ == 0 && WATT_WINDOW % AVG_FREQ == 0, "The windows must hold a whole number of stats updates");
 
 class PowerMeter
 {
   public:
+    // How pulses reach the meter. PULSE_POLLED samples the pin from
+    // update(); PULSE_INTERRUPT timestamps each edge in an ISR so a slow
+    // loop() iteration can no longer delay or lose a pulse.
+    enum PulseMode {
+      PULSE_POLLED,
+      PULSE_INTERRUPT
+    };
+
+    // Which figure watts() reports. ESTIMATE_AVERAGE is the binned
+    // sliding average behind averageW(); ESTIMATE_INTERVAL is intervalW(),
+    // which reacts from the second pulse of a new load. ESTIMATE_CHANGE
+    // is the level from the change detector, which only moves when
+    // change() reports a step in intervalW(). ESTIMATE_CURRENT is the
+    // averageW() of the CT clamp given to clamp(), instead of the pulses.
+    enum Estimator {
+      ESTIMATE_AVERAGE,
+      ESTIMATE_INTERVAL,
+      ESTIMATE_CHANGE,
+      ESTIMATE_CURRENT
+    };
+
     PowerMeter();
-    void attach(int pulsePin);
+    ~PowerMeter();
+    void attach(int pulsePin, PulseMode mode = PULSE_POLLED);
+    bool polled();
+    void clamp(CurrentSensor *clamp);
+    CurrentSensor *clamp();
+    void restore(uint64_t pulses, int32_t watts, int32_t level);
     void update();
     bool pulseSeen();
-    float totalWh();
+    uint32_t pulseInterval();
+    uint32_t pulseTime();
+    uint64_t pulses();
+    uint64_t totalMilliWh();
+    uint64_t totalWh();
+    Q8 totalKWh();
     float averageWh();
     float averageW();
+    float deviationW();
+    int32_t minimumW();
+    int32_t maximumW();
+    float intervalW();
+    float watts();
+    float steadyW();
+    void estimator(Estimator estimator);
+    ChangeDetector::Change change();
+    ChangeDetector &detector();
     void pulse();
+    bool pending();
+    unsigned long maxPulseLatency();
+    unsigned long overruns();
+    unsigned long rejectedPulses();
 
   private:
-    long _timeSinceLastPulse;
-    long _lastPulseTime;
+    // attachInterrupt() takes a plain function, so each interrupt-driven
+    // meter gets a slot with its own trampoline into capture().
+    typedef void (*Isr)();
+    template<uint8_t SLOT> static void isr();
+    static const Isr ISR_SLOTS[METER_ISR_SLOTS];
+    static FIRMWARE_LOCAL PowerMeter *_isrMeters[METER_ISR_SLOTS];
+
+    static void statsDue(void *context);
+
+    void capture(uint32_t timestamp);
+    void recordPulse(uint32_t timestamp);
+
+    uint32_t _pulseInterval;
+    uint32_t _lastPulseTime;
+    bool _lastPulseValid;
+    Estimator _estimator;
     bool _pulseThisFrame;
-    float _totalWhSeen;
-    long _totalPulses;
+    uint64_t _totalPulses;
+    uint32_t _lastStatsUpdate;
+    Timer _statsTimer;
+    bool _statsDue;
+    uint64_t _lastUpdatePulses;
+    uint32_t _maxPulseLatency;
+
+    // Fixed-size, integer-summed windows: no heap, and no float drift.
+    RunningAverage<Q8, AVG_WINDOW/AVG_FREQ> _whPerTick;
+    WindowStats<int32_t, WATT_WINDOW/AVG_FREQ> _wattsAverage;
+    ChangeDetector _detector;
+    ChangeDetector::Change _change;
+    CurrentSensor *_clamp;
+
+    PulseBuffer<PULSE_BUFFER_SIZE> _pulses;
+    uint32_t _lastCapture;
+    bool _captured;
+    volatile uint8_t _rejected;
+    uint8_t _overrunMark;
+    uint8_t _rejectedMark;
+    unsigned long _overruns;
+    unsigned long _rejectedTotal;
 
-    Bounce _sensor;
+    PulseMode _mode;
+    int8_t _input; // The pin's input in the debouncer, when polled.
     int _pin;
 };
 
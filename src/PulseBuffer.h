@@ -0,0 +1,78 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef PulseBuffer_h
+#define PulseBuffer_h
+
+#include <stdint.h>
+
+// Single-producer/single-consumer ring of pulse timestamps.
+//
+// push() is only ever called from the pulse ISR and pop() only from the
+// main loop. Each side owns one of the 8-bit indices, and 8-bit loads
+// and stores are atomic on AVR, so neither side has to disable
+// interrupts. SIZE must be a power of two no larger than 128.
+template <uint8_t SIZE>
+class PulseBuffer
+{
+  public:
+    PulseBuffer() : _head(0), _tail(0), _overruns(0) {}
+
+    // ISR side. A full buffer drops the new timestamp and counts it.
+    bool push(uint32_t timestamp)
+    {
+      uint8_t head = _head;
+      if ((uint8_t)(head - _tail) >= SIZE) {
+        _overruns++;
+        return false;
+      }
+      _buffer[head & MASK] = timestamp;
+      _head = head + 1;
+      return true;
+    }
+
+    // Main loop side. Returns false when there is nothing to read.
+    bool pop(uint32_t &timestamp)
+    {
+      uint8_t tail = _tail;
+      if (tail == _head) {
+        return false;
+      }
+      timestamp = _buffer[tail & MASK];
+      _tail = tail + 1;
+      return true;
+    }
+
+    bool empty() const { return _head == _tail; }
+
+    // Free-running count of dropped timestamps; wraps at 256, so the
+    // reader should accumulate differences between calls.
+    uint8_t overruns() const { return _overruns; }
+
+  private:
+    static const uint8_t MASK = SIZE - 1;
+    static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0,
+                  "PulseBuffer size must be a power of two up to 128");
+
+    volatile uint32_t _buffer[SIZE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    volatile uint8_t _overruns;
+};
+
+#endif
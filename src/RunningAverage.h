@@ -3,9 +3,25 @@
 //
 //    FILE: RunningAverage.h
 //  AUTHOR: Rob dot Tillaart at gmail dot com
+// VERSION: 0.3.00
 // PURPOSE: RunningAverage library for Arduino
 //     URL: http://arduino.cc/playground/Main/RunningAverage
-// HISTORY: See RunningAverage.cpp
+//
+// The library stores the last N individual values in a circular buffer,
+// to calculate the running average.
+//
+// HISTORY:
+// 0.1.00 - 2011-01-30 initial version
+// 0.1.01 - 2011-02-28 fixed missing destructor in .h
+// 0.2.00 - 2012-??-?? Yuval Naveh added trimValue (found on web)
+//          http://stromputer.googlecode.com/svn-history/r74/trunk/Arduino/Libraries/RunningAverage/RunningAverage.cpp
+// 0.2.01 - 2012-11-21 refactored
+// 0.2.02 - 2012-12-30 refactored trimValue -> fillValue
+// 0.2.03 - 2013-11-31 getElement
+// 0.2.04 - 2014-07-03 added memory protection
+// 0.3.00 - AutoVac: header-only RunningAverage<T, N> with the buffer held
+//          inline instead of malloc'd, exact sums for integer and Fixed
+//          samples, and a shift instead of a divide for power-of-two N
 //
 // Released to the public domain
 //
@@ -15,33 +31,144 @@
 // add(x) addValue(x)
 // avg() getAverage()
 
-#define RUNNINGAVERAGE_LIB_VERSION "0.2.04"
+#define RUNNINGAVERAGE_LIB_VERSION "0.3.00"
 
 #include "Arduino.h"
+#include "Fixed.h"
+
+// How samples of type T are summed. Integer and Fixed samples use a
+// wider integer sum, so adding and removing values never drifts; float
+// keeps the old float sum.
+template <typename T>
+struct RunningAverageTraits
+{
+    typedef T sum_type;
+    static const bool integral = false;
+    static sum_type toSum(T value) { return value; }
+    static T fromSum(sum_type sum) { return sum; }
+    static T empty() { return NAN; }
+};
+
+#define RUNNINGAVERAGE_INTEGER_TRAITS(T, S)                   \
+template <>                                                   \
+struct RunningAverageTraits<T>                                \
+{                                                             \
+    typedef S sum_type;                                       \
+    static const bool integral = true;                        \
+    static sum_type toSum(T value) { return value; }          \
+    static T fromSum(sum_type sum) { return (T)sum; }         \
+    static T empty() { return 0; }                            \
+};
+
+RUNNINGAVERAGE_INTEGER_TRAITS(int8_t, int16_t)
+RUNNINGAVERAGE_INTEGER_TRAITS(uint8_t, uint16_t)
+RUNNINGAVERAGE_INTEGER_TRAITS(int16_t, int32_t)
+RUNNINGAVERAGE_INTEGER_TRAITS(uint16_t, uint32_t)
+RUNNINGAVERAGE_INTEGER_TRAITS(int32_t, int64_t)
+RUNNINGAVERAGE_INTEGER_TRAITS(uint32_t, uint64_t)
+
+#undef RUNNINGAVERAGE_INTEGER_TRAITS
+
+template <uint8_t FRAC>
+struct RunningAverageTraits<Fixed<FRAC> >
+{
+    typedef int64_t sum_type;
+    static const bool integral = true;
+    static sum_type toSum(Fixed<FRAC> value) { return value.raw(); }
+    static Fixed<FRAC> fromSum(sum_type sum) { return Fixed<FRAC>::fromRaw((int32_t)sum); }
+    static Fixed<FRAC> empty() { return Fixed<FRAC>(); }
+};
 
+// Divides the sum by the sample count. Integer sums over a full window
+// of a power-of-two size are shifted instead; note that an arithmetic
+// shift rounds negative averages down rather than towards zero.
+template <typename S, bool INTEGRAL>
+struct RunningAverageDivider
+{
+    static S divide(S sum, uint16_t count, uint8_t) { return sum / count; }
+};
+
+template <typename S>
+struct RunningAverageDivider<S, true>
+{
+    static S divide(S sum, uint16_t count, uint8_t shift)
+    {
+        if (shift) return sum >> shift;
+        return sum / (S)count;
+    }
+};
+
+constexpr uint8_t runningAverageLog2(uint16_t n)
+{
+    return n <= 1 ? 0 : 1 + runningAverageLog2(n / 2);
+}
+
+template <typename T, uint16_t N, typename S = typename RunningAverageTraits<T>::sum_type>
 class RunningAverage
 {
 public:
-    RunningAverage(void);
-    RunningAverage(int);
-    ~RunningAverage();
+    RunningAverage() { clear(); }
+
+    // resets all counters
+    void clear()
+    {
+        _cnt = 0;
+        _idx = 0;
+        _sum = 0;
+        for (uint16_t i = 0; i < N; i++) _ar[i] = T();  // needed to keep addValue simple
+    }
 
-    void clear();
-    void addValue(float);
-    void fillValue(float, int);
+    // adds a new value to the data-set
+    void addValue(T value)
+    {
+        _sum -= Traits::toSum(_ar[_idx]);
+        _ar[_idx] = value;
+        _sum += Traits::toSum(value);
+        _idx++;
+        if (_idx == N) _idx = 0;  // faster than %
+        if (_cnt < N) _cnt++;
+    }
 
-    float getAverage();
+    // fill the average with a value
+    // the param number determines how often value is added (weight)
+    // number should preferably be between 1 and size
+    void fillValue(T value, uint16_t number)
+    {
+        clear();
+        for (uint16_t i = 0; i < number; i++)
+        {
+            addValue(value);
+        }
+    }
 
-    float getElement(uint8_t idx);
-    uint8_t getSize() { return _size; }
-    uint8_t getCount() { return _cnt; }
+    // returns the average of the data-set added sofar
+    T getAverage() const
+    {
+        if (_cnt == 0) return Traits::empty();
+        uint8_t shift = (POWER_OF_TWO && _cnt == N) ? LOG2_N : 0;
+        return Traits::fromSum(RunningAverageDivider<S, Traits::integral>::divide(_sum, _cnt, shift));
+    }
+
+    // returns the value of an element if exist, empty otherwise
+    T getElement(uint16_t idx) const
+    {
+        if (idx >= _cnt) return Traits::empty();
+        return _ar[idx];
+    }
+
+    uint16_t getSize() const { return N; }
+    uint16_t getCount() const { return _cnt; }
 
 protected:
-    uint8_t _size;
-    uint8_t _cnt;
-    uint8_t _idx;
-    float   _sum;
-    float * _ar;
+    typedef RunningAverageTraits<T> Traits;
+    static const bool POWER_OF_TWO = (N & (N - 1)) == 0;
+    static const uint8_t LOG2_N = runningAverageLog2(N);
+    static_assert(N > 0, "RunningAverage needs at least one element");
+
+    uint16_t _cnt;
+    uint16_t _idx;
+    S        _sum;
+    T        _ar[N];
 };
 
 #endif
@@ -0,0 +1,67 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Settings.h"
+#include <EEPROM.h>
+#include <stddef.h>
+
+static_assert(SETTINGS_ADDRESS + SETTINGS_SLOTS * sizeof(Settings) <= E2END + 1, "Settings must fit the EEPROM");
+
+
+// Sum of every byte but the check byte, seeded so that a zeroed record fails.
+static uint8_t checkOf(const Settings &settings)
+{
+  const uint8_t *bytes = (const uint8_t *)&settings;
+  uint8_t sum = 0x5A;
+  for(uint8_t i = 0; i < offsetof(Settings, check); i++) {
+    sum += bytes[i];
+  }
+  return sum;
+}
+
+
+static int addressOf(uint8_t slot)
+{
+  return SETTINGS_ADDRESS + slot * sizeof(Settings);
+}
+
+
+bool loadSettings(Settings &settings, uint8_t slot)
+{
+  Settings stored;
+  if(slot >= SETTINGS_SLOTS) {
+    return false;
+  }
+  EEPROM.get(addressOf(slot), stored);
+  if(stored.version != SETTINGS_VERSION || stored.check != checkOf(stored)) {
+    return false;
+  }
+  settings = stored;
+  return true;
+}
+
+
+// Only bytes that have changed are written, to spare the EEPROM.
+void saveSettings(Settings &settings, uint8_t slot)
+{
+  settings.version = SETTINGS_VERSION;
+  settings.check = checkOf(settings);
+  if(slot < SETTINGS_SLOTS) {
+    EEPROM.put(addressOf(slot), settings);
+  }
+}
@@ -0,0 +1,45 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Settings_h
+#define Settings_h
+
+#include <stdint.h>
+
+#define SETTINGS_ADDRESS 0 // EEPROM offset of the first settings record.
+#define SETTINGS_SLOTS   8 // Records, one per channel, one after the other.
+#define SETTINGS_VERSION 1 // Bump when the layout below changes.
+
+// Everything the firmware keeps in EEPROM between power cycles.
+//
+// The record ends in a check byte, so that a blank EEPROM, one written
+// by other firmware or a half-finished write all read as "no settings"
+// and the defaults are used instead.
+struct Settings {
+  uint8_t version;
+  uint8_t learned;         // Calibration::LEARNED_* bits for the levels below.
+  uint16_t baselineWatts;  // Circuit draw with nothing running.
+  uint16_t vacuumWatts;    // What the vacuum adds.
+  uint16_t toolWatts;      // What the tool adds.
+  uint8_t check;
+};
+
+bool loadSettings(Settings &settings, uint8_t slot = 0);
+void saveSettings(Settings &settings, uint8_t slot = 0);
+
+#endif
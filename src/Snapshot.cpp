@@ -0,0 +1,97 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Snapshot.h"
+#include "Board.h"
+#include <EEPROM.h>
+#include <stddef.h>
+#include <util/crc16.h>
+
+#define SNAPSHOT_SLOTS ((E2END + 1 - SNAPSHOT_ADDRESS) / sizeof(Snapshot))
+
+static_assert(SNAPSHOT_SLOTS >= 2, "The EEPROM needs room for at least two snapshots after the settings");
+static_assert(SNAPSHOT_SLOTS < 128, "Sequence numbers must tell the newest snapshot apart");
+
+static FIRMWARE_LOCAL uint8_t nextSlot = SNAPSHOT_SLOTS; // Where the next snapshot goes; SNAPSHOT_SLOTS until the ring has been read.
+static FIRMWARE_LOCAL uint8_t nextSequence = 0;
+
+
+// CRC-CCITT of every byte but the CRC, seeded so that a zeroed record fails.
+static uint16_t crcOf(const Snapshot &snapshot)
+{
+  const uint8_t *bytes = (const uint8_t *)&snapshot;
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 0; i < offsetof(Snapshot, crc); i++) {
+    crc = _crc_ccitt_update(crc, bytes[i]);
+  }
+  return crc;
+}
+
+
+static int addressOf(uint8_t slot)
+{
+  return SNAPSHOT_ADDRESS + slot * sizeof(Snapshot);
+}
+
+
+static uint8_t after(uint8_t slot)
+{
+  return slot + 1u < SNAPSHOT_SLOTS ? slot + 1 : 0;
+}
+
+
+static bool valid(const Snapshot &snapshot)
+{
+  return snapshot.version == SNAPSHOT_VERSION && snapshot.channels <= SNAPSHOT_CHANNELS
+      && snapshot.crc == crcOf(snapshot);
+}
+
+
+// Finds the newest good snapshot, and where the one after it goes.
+bool loadSnapshot(Snapshot &snapshot)
+{
+  bool found = false;
+  nextSlot = 0;
+  nextSequence = 0;
+  for(uint8_t slot = 0; slot < SNAPSHOT_SLOTS; slot++) {
+    Snapshot stored;
+    EEPROM.get(addressOf(slot), stored);
+    if(!valid(stored) || (found && (int8_t)(stored.sequence - snapshot.sequence) <= 0)) {
+      continue;
+    }
+    snapshot = stored;
+    found = true;
+    nextSlot = after(slot);
+    nextSequence = stored.sequence + 1;
+  }
+  return found;
+}
+
+
+void saveSnapshot(Snapshot &snapshot)
+{
+  if(nextSlot == SNAPSHOT_SLOTS) {
+    Snapshot newest;
+    loadSnapshot(newest);
+  }
+  snapshot.version = SNAPSHOT_VERSION;
+  snapshot.sequence = nextSequence++;
+  snapshot.crc = crcOf(snapshot);
+  EEPROM.put(addressOf(nextSlot), snapshot);
+  nextSlot = after(nextSlot);
+}
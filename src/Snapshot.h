@@ -0,0 +1,60 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Snapshot_h
+#define Snapshot_h
+
+#include <stdint.h>
+#include "Settings.h"
+
+#define SNAPSHOT_ADDRESS  (SETTINGS_ADDRESS + SETTINGS_SLOTS * sizeof(Settings)) // Straight after the settings.
+#define SNAPSHOT_CHANNELS 8      // Channels a snapshot has room for.
+#define SNAPSHOT_VERSION  2      // Bump when the layout below changes.
+#define SNAPSHOT_PERIOD   300000 // ms between snapshots when no state has changed.
+#define SNAPSHOT_HOLDOFF  5000   // ms at least between two snapshots.
+
+// What a channel was doing, so that it can carry on after a reset.
+struct ChannelSnapshot {
+  uint8_t state;     // Its State_type.
+  uint16_t watts;    // The meter's averaged power.
+  uint16_t level;    // The change detector's level.
+  uint64_t pulses;   // Meter pulses counted, for the energy total.
+};
+
+// The state of every channel, kept in EEPROM to be picked up after a
+// brown-out or a reset.
+//
+// Snapshots go round a ring of slots filling the rest of the EEPROM, so
+// that each byte is written only once every so many snapshots. A 1K
+// EEPROM has eight slots; with a tool started and stopped every minute,
+// three state changes a time, its bytes reach their 100,000 writes after
+// some 4,000 hours of that. The newest snapshot is the one with the
+// highest sequence number whose CRC is good, so a write cut short by the
+// power going leaves the one before it to be loaded.
+struct Snapshot {
+  uint8_t version;
+  uint8_t sequence;
+  uint8_t channels;  // How many of the channel records are used.
+  ChannelSnapshot channel[SNAPSHOT_CHANNELS];
+  uint16_t crc;
+};
+
+bool loadSnapshot(Snapshot &snapshot);
+void saveSnapshot(Snapshot &snapshot);
+
+#endif
@@ -0,0 +1,196 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "StateMachine.h"
+#include <stddef.h>
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0, "EVENT_QUEUE_SIZE must be a power of two");
+static_assert(STATE_COUNT < 255 && EVENT_COUNT < 255, "States and events must fit a byte");
+
+
+StateMachine::StateMachine(const StateActions *actions, void *context) : _timer(expired, this)
+{
+  _actions = actions;
+  _context = context;
+  _state = STATE_COUNT;
+  _head = 0;
+  _tail = 0;
+  _dropped = 0;
+  _armed = EVENT_COUNT;
+  _power = EVENT_COUNT;
+  _powerDropped = false;
+  _timeout = 0;
+  _timerExpired = false;
+}
+
+
+void StateMachine::begin(State_type initial)
+{
+  enter(initial);
+}
+
+
+// Runs the timer for ms in every state the table gives a timeout, from
+// the next time one is entered; 0 goes back to the table's own.
+void StateMachine::timeout(uint32_t ms)
+{
+  _timeout = ms;
+}
+
+
+bool StateMachine::post(Event_type event)
+{
+  if((uint8_t)(_head - _tail) >= EVENT_QUEUE_SIZE) {
+    _dropped++;
+    return false;
+  }
+  _queue[_head & (EVENT_QUEUE_SIZE - 1)] = event;
+  _head++;
+  return true;
+}
+
+
+bool StateMachine::dispatch()
+{
+  bool changed = false;
+  while(_tail != _head) {
+    uint8_t event = _queue[_tail & (EVENT_QUEUE_SIZE - 1)];
+    _tail++;
+    if(!apply(event)) {
+      continue;
+    }
+    changed = true;
+
+    // Let the new state see the current levels. Each pass can move to
+    // another state; there can't be more useful passes than states. A
+    // level with a newer event still queued is left to that event, so
+    // the new state can't act on one that has already changed.
+    bool armedQueued = queued(EVENT_ARMED, EVENT_DISARMED);
+    bool powerQueued = queued(EVENT_POWER_TOOL, EVENT_POWER_LOW);
+    for(uint8_t i = 0; i < STATE_COUNT; i++) {
+      if((armedQueued || !apply(_armed)) && (powerQueued || !apply(_power))) {
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+
+State_type StateMachine::state()
+{
+  return (State_type)_state;
+}
+
+
+unsigned long StateMachine::droppedEvents()
+{
+  return _dropped;
+}
+
+
+// Records the event and takes the first matching transition whose guard
+// passes. Returns true if the state changed.
+bool StateMachine::apply(uint8_t event)
+{
+  switch(event) {
+    case EVENT_ARMED:
+    case EVENT_DISARMED:
+      _armed = event;
+      break;
+    case EVENT_POWER_LOW:
+      _powerDropped = true;
+      // fall through
+    case EVENT_POWER_TOOL:
+    case EVENT_POWER_HIGH:
+      _power = event;
+      break;
+    case EVENT_TIMER:
+      _timerExpired = true;
+      break;
+    case EVENT_COUNT:
+      return false;
+  }
+
+  uint8_t last = pgm_read_byte(&STATE_FIRST_ROW[_state + 1]);
+  for(uint8_t row = pgm_read_byte(&STATE_FIRST_ROW[_state]); row < last; row++) {
+    Transition t;
+    memcpy_P(&t, &STATE_TRANSITIONS[row], sizeof(t));
+    if(t.event == event && passes(t.guard)) {
+      enter(t.next);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// Whether an event from first to last, in Event_type order, is waiting
+// in the queue.
+bool StateMachine::queued(uint8_t first, uint8_t last)
+{
+  for(uint8_t i = _tail; i != _head; i++) {
+    uint8_t event = _queue[i & (EVENT_QUEUE_SIZE - 1)];
+    if(event >= first && event <= last) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void StateMachine::expired(void *context)
+{
+  ((StateMachine *)context)->post(EVENT_TIMER);
+}
+
+
+bool StateMachine::passes(uint8_t guard)
+{
+  switch(guard) {
+    case GUARD_TIMER_EXPIRED:
+      return _timerExpired;
+    case GUARD_POWER_NOT_HIGH:
+      return _power != EVENT_POWER_HIGH;
+    case GUARD_POWER_DROPPED:
+      return _powerDropped;
+    default:
+      return true;
+  }
+}
+
+
+void StateMachine::enter(uint8_t state)
+{
+  if(_state < STATE_COUNT && _actions[_state].exit != NULL) {
+    _actions[_state].exit(_context);
+  }
+
+  _state = state;
+  _powerDropped = false;
+  _timerExpired = false;
+  if(_actions[_state].timeout > 0) {
+    timers.start(_timer, _timeout > 0 ? _timeout : _actions[_state].timeout);
+  } else {
+    timers.stop(_timer);
+  }
+
+  if(_actions[_state].enter != NULL) {
+    _actions[_state].enter(_context);
+  }
+}
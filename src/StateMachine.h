@@ -0,0 +1,85 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef StateMachine_h
+#define StateMachine_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "StateTable.h"
+#include "Timers.h"
+
+#define EVENT_QUEUE_SIZE 8 // Must be a power of two.
+
+// Event-driven engine for the transition table in StateTable.h.
+//
+// Inputs and timers post events; dispatch() runs them through the table
+// and does nothing at all when the queue is empty. The engine remembers
+// the last armed/disarmed and power level events, and re-applies them
+// after each transition so that level conditions ("armed", "power is
+// low") take effect in the new state without anything being polled.
+class StateMachine
+{
+  public:
+    // Actions get the context the machine was made with, so that one
+    // table can drive several machines.
+    typedef void (*Action)(void *context);
+
+    // Per-state behaviour. A non-zero timeout starts the state timer on
+    // entry, which posts EVENT_TIMER from Timers::run() once it has run
+    // for that long. timeout() gives one machine another length for all
+    // of its timed states, so the table itself can stay const.
+    struct StateActions {
+      Action enter;
+      Action exit;
+      uint32_t timeout;
+    };
+
+    StateMachine(const StateActions *actions, void *context = NULL);
+    void begin(State_type initial);
+    void timeout(uint32_t ms);
+    bool post(Event_type event);
+    bool dispatch();
+    State_type state();
+    unsigned long droppedEvents();
+
+  private:
+    bool apply(uint8_t event);
+    bool queued(uint8_t first, uint8_t last);
+    bool passes(uint8_t guard);
+    void enter(uint8_t state);
+    static void expired(void *context);
+
+    const StateActions *_actions;
+    void *_context;
+    uint8_t _state;
+    uint8_t _queue[EVENT_QUEUE_SIZE];
+    uint8_t _head;
+    uint8_t _tail;
+    unsigned long _dropped;
+
+    uint8_t _armed;
+    uint8_t _power;
+    bool _powerDropped;
+
+    Timer _timer;
+    uint32_t _timeout;
+    bool _timerExpired;
+};
+
+#endif
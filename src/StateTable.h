@@ -0,0 +1,100 @@
+// Generated by tools/fsmgen.py from doc/fsm.dot. Do not edit; change the
+// diagram and regenerate instead.
+
+#ifndef StateTable_h
+#define StateTable_h
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+typedef enum {
+	STATE_MANUAL_IDLE = 0,
+	STATE_MANUAL_RUNNING,
+	STATE_AUTO_IDLE,
+	STATE_AUTO_RUNNING,
+	STATE_AUTO_FORCED_RUNNING,
+	STATE_AUTO_FORCED_STOPPED,
+	STATE_AUTO_COOLING_DOWN,
+	STATE_COUNT
+} State_type;
+
+typedef enum {
+	EVENT_OVERRIDE = 0,
+	EVENT_ARMED,
+	EVENT_DISARMED,
+	EVENT_POWER_TOOL,
+	EVENT_POWER_HIGH,
+	EVENT_POWER_LOW,
+	EVENT_TIMER,
+	EVENT_COUNT
+} Event_type;
+
+typedef enum {
+	GUARD_NONE = 0,
+	GUARD_TIMER_EXPIRED,
+	GUARD_POWER_NOT_HIGH,
+	GUARD_POWER_DROPPED,
+	GUARD_COUNT
+} Guard_type;
+
+struct Transition {
+	uint8_t state;
+	uint8_t event;
+	uint8_t guard;
+	uint8_t next;
+};
+
+// Rows are grouped by state; within a state, rows for the same event
+// are tried in order until one's guard passes.
+constexpr Transition STATE_TRANSITIONS[] PROGMEM = {
+	{ STATE_MANUAL_IDLE, EVENT_OVERRIDE, GUARD_NONE, STATE_MANUAL_RUNNING },
+	{ STATE_MANUAL_IDLE, EVENT_ARMED, GUARD_NONE, STATE_AUTO_IDLE },
+	{ STATE_MANUAL_RUNNING, EVENT_OVERRIDE, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_MANUAL_RUNNING, EVENT_ARMED, GUARD_NONE, STATE_AUTO_IDLE },
+	{ STATE_AUTO_IDLE, EVENT_DISARMED, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_IDLE, EVENT_OVERRIDE, GUARD_NONE, STATE_AUTO_FORCED_RUNNING },
+	{ STATE_AUTO_IDLE, EVENT_POWER_TOOL, GUARD_NONE, STATE_AUTO_RUNNING },
+	{ STATE_AUTO_IDLE, EVENT_POWER_HIGH, GUARD_NONE, STATE_AUTO_RUNNING },
+	{ STATE_AUTO_RUNNING, EVENT_DISARMED, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_RUNNING, EVENT_OVERRIDE, GUARD_NONE, STATE_AUTO_FORCED_STOPPED },
+	{ STATE_AUTO_RUNNING, EVENT_POWER_LOW, GUARD_TIMER_EXPIRED, STATE_AUTO_COOLING_DOWN },
+	{ STATE_AUTO_RUNNING, EVENT_POWER_TOOL, GUARD_TIMER_EXPIRED, STATE_AUTO_COOLING_DOWN },
+	{ STATE_AUTO_RUNNING, EVENT_TIMER, GUARD_POWER_NOT_HIGH, STATE_AUTO_COOLING_DOWN },
+	{ STATE_AUTO_FORCED_RUNNING, EVENT_DISARMED, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_FORCED_RUNNING, EVENT_OVERRIDE, GUARD_NONE, STATE_AUTO_COOLING_DOWN },
+	{ STATE_AUTO_FORCED_STOPPED, EVENT_DISARMED, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_FORCED_STOPPED, EVENT_OVERRIDE, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_FORCED_STOPPED, EVENT_POWER_LOW, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_FORCED_STOPPED, EVENT_POWER_TOOL, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_COOLING_DOWN, EVENT_DISARMED, GUARD_NONE, STATE_MANUAL_IDLE },
+	{ STATE_AUTO_COOLING_DOWN, EVENT_POWER_LOW, GUARD_TIMER_EXPIRED, STATE_AUTO_IDLE },
+	{ STATE_AUTO_COOLING_DOWN, EVENT_TIMER, GUARD_POWER_DROPPED, STATE_AUTO_IDLE },
+};
+
+const uint8_t STATE_TRANSITION_COUNT = sizeof(STATE_TRANSITIONS) / sizeof(STATE_TRANSITIONS[0]);
+
+constexpr uint8_t stateFirstRow(uint8_t state, uint8_t row = 0)
+{
+	return row >= STATE_TRANSITION_COUNT || STATE_TRANSITIONS[row].state >= state ? row : stateFirstRow(state, row + 1);
+}
+
+constexpr bool stateRowsGrouped(uint8_t row = 1)
+{
+	return row >= STATE_TRANSITION_COUNT || (STATE_TRANSITIONS[row - 1].state <= STATE_TRANSITIONS[row].state && stateRowsGrouped(row + 1));
+}
+
+static_assert(stateRowsGrouped(), "STATE_TRANSITIONS must be grouped by state");
+
+// STATE_TRANSITIONS rows for state s are [STATE_FIRST_ROW[s], STATE_FIRST_ROW[s + 1]).
+constexpr uint8_t STATE_FIRST_ROW[] PROGMEM = {
+	stateFirstRow(STATE_MANUAL_IDLE),
+	stateFirstRow(STATE_MANUAL_RUNNING),
+	stateFirstRow(STATE_AUTO_IDLE),
+	stateFirstRow(STATE_AUTO_RUNNING),
+	stateFirstRow(STATE_AUTO_FORCED_RUNNING),
+	stateFirstRow(STATE_AUTO_FORCED_STOPPED),
+	stateFirstRow(STATE_AUTO_COOLING_DOWN),
+	stateFirstRow(STATE_COUNT),
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Telemetry.h"
+
+#ifdef TELEMETRY
+#include "EventLog.h"
+
+FIRMWARE_LOCAL Telemetry telemetry;
+
+
+static int32_t distance(int32_t a, int32_t b)
+{
+  return a > b ? a - b : b - a;
+}
+
+
+Telemetry::Telemetry() : _timer(due, this)
+{
+  _channels = NULL;
+  _count = 0;
+}
+
+
+// Starts with nothing sent, so the first period sends every channel's
+// power and counters that aren't zero.
+void Telemetry::begin(Channel *channels, uint8_t count)
+{
+  _channels = channels;
+  _count = count;
+  uint32_t now = timers.now();
+  for(uint8_t i = 0; i < _count; i++) {
+    Sent &sent = _sent[i];
+    sent.average = 0;
+    sent.interval = 0;
+    sent.powerAt = now - TELEMETRY_REFRESH;
+    sent.pulses = 0;
+    sent.lost = 0;
+    sent.countersAt = now - TELEMETRY_REFRESH;
+  }
+  timers.start(_timer, TELEMETRY_PERIOD, TELEMETRY_PERIOD);
+}
+
+
+// `at` is the micros() the pulse was captured at.
+void Telemetry::pulse(uint8_t channel, uint32_t interval, uint32_t at)
+{
+  if(eventLog.space() > TELEMETRY_RESERVE) {
+    eventLog.write(LOG_PULSE, channel, interval, micros() - at);
+  }
+}
+
+
+void Telemetry::due(void *context)
+{
+  ((Telemetry *)context)->send(timers.now());
+}
+
+
+void Telemetry::send(uint32_t now)
+{
+  for(uint8_t i = 0; i < _count; i++) {
+    if(!sendPower(i, now) || !sendCounters(i, now)) {
+      return;
+    }
+  }
+}
+
+
+// False if there was a change to send but no room for it.
+bool Telemetry::sendPower(uint8_t channel, uint32_t now)
+{
+  PowerMeter &meter = _channels[channel].meter();
+  Sent &sent = _sent[channel];
+  int32_t average = meter.averageW();
+  int32_t interval = meter.intervalW();
+  if(average == sent.average && interval == sent.interval) {
+    return true;
+  }
+  bool moved = distance(average, sent.average) >= TELEMETRY_WATTS || distance(interval, sent.interval) >= TELEMETRY_WATTS;
+  if(!moved && now - sent.powerAt < TELEMETRY_REFRESH) {
+    return true;
+  }
+  if(eventLog.space() <= TELEMETRY_RESERVE) {
+    return false;
+  }
+  eventLog.write(LOG_POWER, channel, average, interval);
+  sent.average = average;
+  sent.interval = interval;
+  sent.powerAt = now;
+  return true;
+}
+
+
+bool Telemetry::sendCounters(uint8_t channel, uint32_t now)
+{
+  PowerMeter &meter = _channels[channel].meter();
+  Sent &sent = _sent[channel];
+  uint32_t pulses = meter.pulses();
+  unsigned long lost = meter.overruns() + meter.rejectedPulses();
+  if(pulses == sent.pulses && lost == sent.lost) {
+    return true;
+  }
+  if(lost == sent.lost && now - sent.countersAt < TELEMETRY_REFRESH) {
+    return true;
+  }
+  if(eventLog.space() <= TELEMETRY_RESERVE) {
+    return false;
+  }
+  eventLog.write(LOG_COUNTERS, channel, pulses, lost);
+  sent.pulses = pulses;
+  sent.lost = lost;
+  sent.countersAt = now;
+  return true;
+}
+
+#endif
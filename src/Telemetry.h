@@ -0,0 +1,96 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#include <Arduino.h>
+#include "Channel.h"
+#include "Timers.h"
+
+// #define TELEMETRY 1 // Stream pulses, power and counters for host/logdecode; or build with -DTELEMETRY.
+
+#define TELEMETRY_PERIOD  250   // ms between looks for values that have changed.
+#define TELEMETRY_WATTS   10    // W a power figure has to move by to be sent again straight away.
+#define TELEMETRY_REFRESH 60000 // ms after which any change at all is sent.
+#define TELEMETRY_RESERVE 2     // Log records left free for the firmware's own events.
+
+#ifdef TELEMETRY
+
+// Per-channel readings for logging a whole shift on a host, sent as
+// event log records alongside the state changes the channels log anyway.
+//
+// A pass of the loop that saw a meter pulse sends a LOG_PULSE, with the
+// interval since the pulse before and how long before the record's time
+// the ISR captured the pulse, as the record is only stamped when the
+// loop gets to it. A pass that took in several pulses sends the last of
+// them; the rest only show in the LOG_COUNTERS totals.
+//
+// Every TELEMETRY_PERIOD, each channel's power goes out as a LOG_POWER
+// if it has moved by TELEMETRY_WATTS, and its counters as a LOG_COUNTERS
+// if pulses were lost; smaller changes wait until the channel's last
+// record of that kind is TELEMETRY_REFRESH old. Nothing is sent for a
+// value that hasn't changed.
+//
+// Telemetry only writes while the log has more than TELEMETRY_RESERVE
+// records free. A change that doesn't fit is sent on a later period; a
+// pulse that doesn't fit is left out, and shows up in the next
+// LOG_COUNTERS total.
+class Telemetry
+{
+  public:
+    Telemetry();
+    void begin(Channel *channels, uint8_t count);
+    void pulse(uint8_t channel, uint32_t interval, uint32_t at);
+
+  private:
+    struct Sent {
+      int32_t average;
+      int32_t interval;
+      uint32_t powerAt;
+      uint32_t pulses;  // The low 32 bits, which are what the log sends.
+      unsigned long lost;
+      uint32_t countersAt;
+    };
+
+    static void due(void *context);
+    void send(uint32_t now);
+    bool sendPower(uint8_t channel, uint32_t now);
+    bool sendCounters(uint8_t channel, uint32_t now);
+
+    Channel *_channels;
+    uint8_t _count;
+    Timer _timer;
+    Sent _sent[CHANNEL_MAX];
+};
+
+extern FIRMWARE_LOCAL Telemetry telemetry;
+
+#define TELEMETRY_BEGIN(channels, count)       telemetry.begin(channels, count)
+#define TELEMETRY_PULSE(channel, interval, at) telemetry.pulse(channel, interval, at)
+#define TELEMETRY_RAM                          sizeof(Telemetry)
+
+#else
+
+#define TELEMETRY_BEGIN(channels, count)       do {} while(0)
+#define TELEMETRY_PULSE(channel, interval, at) do {} while(0)
+#define TELEMETRY_RAM                          0
+
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Tickless.h"
+#include <avr/sleep.h>
+
+#if defined(__AVR__)
+#include <avr/interrupt.h>
+
+// A pin-change interrupt only has to wake the CPU; sleep() samples the
+// watched pins afterwards to see what changed.
+#if defined(PCINT0_vect)
+EMPTY_INTERRUPT(PCINT0_vect);
+#endif
+#if defined(PCINT1_vect)
+EMPTY_INTERRUPT(PCINT1_vect);
+#endif
+#if defined(PCINT2_vect)
+EMPTY_INTERRUPT(PCINT2_vect);
+#endif
+#endif
+
+
+Tickless::Tickless()
+{
+  _levels = 0;
+  _count = 0;
+  _now = 0;
+  _deadline = 0;
+  _sleeps = 0;
+}
+
+
+void Tickless::watch(uint8_t pin)
+{
+  if(_count >= TICKLESS_MAX_PINS) {
+    return;
+  }
+  _pins[_count] = pin;
+  if(digitalRead(pin)) {
+    _levels |= 1 << _count;
+  }
+  _count++;
+
+#if defined(__AVR__) && defined(digitalPinToPCICR)
+  volatile uint8_t *pcicr = digitalPinToPCICR(pin);
+  if(pcicr) {
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    *pcicr |= _BV(digitalPinToPCICRbit(pin));
+  }
+#endif
+}
+
+
+void Tickless::begin(uint32_t now)
+{
+  _now = now;
+  _deadline = now + TICKLESS_MAX_IDLE;
+}
+
+
+void Tickless::until(uint32_t deadline)
+{
+  if((int32_t)(deadline - _now) < (int32_t)(_deadline - _now)) {
+    _deadline = deadline;
+  }
+}
+
+
+void Tickless::sleep(BusyCheck busy)
+{
+  while(true) {
+    // The debouncer sets a timer for its next sample once it sees the
+    // change, so the loop only has to run the once.
+    if(inputsChanged()) {
+      return;
+    }
+
+    // Check for work and go to sleep with interrupts off, so a pulse
+    // arriving in between can't be slept through. The instruction after
+    // sei always runs before any pending interrupt, so sleep_cpu() is
+    // entered before the interrupt can fire and then wakes straight up.
+    noInterrupts();
+    if((int32_t)(millis() - _deadline) >= 0 || (busy != NULL && busy())) {
+      interrupts();
+      return;
+    }
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+    _sleeps++;
+  }
+}
+
+
+unsigned long Tickless::sleeps()
+{
+  return _sleeps;
+}
+
+
+bool Tickless::inputsChanged()
+{
+  uint8_t levels = 0;
+  for(uint8_t i = 0; i < _count; i++) {
+    if(digitalRead(_pins[i])) {
+      levels |= 1 << i;
+    }
+  }
+  bool changed = levels != _levels;
+  _levels = levels;
+  return changed;
+}
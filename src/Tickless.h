@@ -0,0 +1,61 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Tickless_h
+#define Tickless_h
+
+#include <Arduino.h>
+
+#define TICKLESS_MAX_PINS 8    // The armed switch, override buttons and polled meters; one bit each in _levels.
+#define TICKLESS_MAX_IDLE 1000 // ms; never sleep longer than this, deadline or not.
+
+// Sleeps the MCU between the deadlines of the rest of the firmware.
+//
+// Each pass of loop() calls begin(), passes the earliest deadline in
+// Timers to until(), and then calls sleep(). The CPU
+// idles until the earliest deadline, a watched pin changes, or the
+// busy() callback reports pending work (such as queued meter pulses).
+//
+// Idle mode is used rather than power-down so that timer0, and with it
+// millis(), keeps running. Watched pins get a pin-change interrupt where
+// the chip has one; they are also sampled on every timer0 wake-up, which
+// covers pins without one.
+class Tickless
+{
+  public:
+    typedef bool (*BusyCheck)();
+
+    Tickless();
+    void watch(uint8_t pin);
+    void begin(uint32_t now);
+    void until(uint32_t deadline);
+    void sleep(BusyCheck busy);
+    unsigned long sleeps();
+
+  private:
+    bool inputsChanged();
+
+    uint8_t _pins[TICKLESS_MAX_PINS];
+    uint8_t _levels;
+    uint8_t _count;
+    uint32_t _now;
+    uint32_t _deadline;
+    unsigned long _sleeps;
+};
+
+#endif
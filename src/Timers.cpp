@@ -0,0 +1,238 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#include "Timers.h"
+
+#define TIMER_STOPPED 0xFF
+
+static_assert(TIMERS_MAX < TIMER_STOPPED, "Heap slots must fit a byte");
+
+FIRMWARE_LOCAL Timers timers;
+
+
+Timer::Timer(Callback callback, void *context)
+{
+  _callback = callback;
+  _context = context;
+  _at = 0;
+  _period = 0;
+  _slot = TIMER_STOPPED;
+}
+
+
+Timer::~Timer()
+{
+  timers.stop(*this);
+}
+
+
+bool Timer::running()
+{
+  return _slot != TIMER_STOPPED;
+}
+
+
+uint32_t Timer::deadline()
+{
+  return _at;
+}
+
+
+Timers::Timers()
+{
+  _count = 0;
+  _now = 0;
+  _overflows = 0;
+}
+
+
+// Samples the clock for this pass of the loop.
+uint32_t Timers::tick()
+{
+  _now = millis();
+  return _now;
+}
+
+
+uint32_t Timers::now()
+{
+  return _now;
+}
+
+
+// Runs the timer delay millis from now(), and then every period millis
+// if period isn't 0. A running timer is moved to the new time. Returns
+// false if there is no room for another timer.
+bool Timers::start(Timer &timer, uint32_t delay, uint32_t period)
+{
+  timer._period = period;
+  return startAt(timer, _now + delay);
+}
+
+
+bool Timers::startAt(Timer &timer, uint32_t at)
+{
+  if(timer._slot == TIMER_STOPPED) {
+    if(_count >= TIMERS_MAX) {
+      _overflows++;
+      return false;
+    }
+    timer._at = at;
+    place(_count++, &timer);
+    up(timer._slot);
+    return true;
+  }
+
+  bool sooner = (int32_t)(at - timer._at) < 0;
+  timer._at = at;
+  if(sooner) {
+    up(timer._slot);
+  } else {
+    down(timer._slot);
+  }
+  return true;
+}
+
+
+void Timers::stop(Timer &timer)
+{
+  uint8_t slot = timer._slot;
+  if(slot == TIMER_STOPPED) {
+    return;
+  }
+  timer._slot = TIMER_STOPPED;
+  _count--;
+  if(slot == _count) {
+    return;
+  }
+
+  // The last timer fills the gap, and then finds its place from there.
+  Timer *moved = _heap[_count];
+  place(slot, moved);
+  up(slot);
+  down(moved->_slot);
+}
+
+
+// Calls back every timer that is due at now(), earliest first, and
+// returns how many there were. A callback may start or stop any timer;
+// one that has come due again straight away waits for the next run().
+uint8_t Timers::run()
+{
+  uint8_t fired = 0;
+  while(_count > 0 && fired < TIMERS_MAX && reached(_heap[0]->_at, _now)) {
+    Timer &timer = *_heap[0];
+    if(timer._period > 0) {
+      // Periods missed while the loop was busy are skipped, not caught up.
+      uint32_t at = timer._at + timer._period;
+      if(reached(at, _now)) {
+        at = _now + timer._period;
+      }
+      startAt(timer, at);
+    } else {
+      stop(timer);
+    }
+    fired++;
+    if(timer._callback != NULL) {
+      timer._callback(timer._context);
+    }
+  }
+  return fired;
+}
+
+
+// When the earliest timer is due, if any are running.
+bool Timers::nextDeadline(uint32_t &at)
+{
+  if(_count == 0) {
+    return false;
+  }
+  at = _heap[0]->_at;
+  return true;
+}
+
+
+uint8_t Timers::count()
+{
+  return _count;
+}
+
+
+// Timers that couldn't be started because the heap was full.
+unsigned long Timers::overflows()
+{
+  return _overflows;
+}
+
+
+// True once now has got to deadline, across the millis() wrap.
+bool Timers::reached(uint32_t deadline, uint32_t now)
+{
+  return (int32_t)(now - deadline) >= 0;
+}
+
+
+bool Timers::earlier(uint8_t a, uint8_t b)
+{
+  return (int32_t)(_heap[a]->_at - _heap[b]->_at) < 0;
+}
+
+
+void Timers::place(uint8_t slot, Timer *timer)
+{
+  _heap[slot] = timer;
+  timer->_slot = slot;
+}
+
+
+void Timers::up(uint8_t slot)
+{
+  while(slot > 0) {
+    uint8_t parent = (slot - 1) / 2;
+    if(!earlier(slot, parent)) {
+      break;
+    }
+    Timer *timer = _heap[parent];
+    place(parent, _heap[slot]);
+    place(slot, timer);
+    slot = parent;
+  }
+}
+
+
+void Timers::down(uint8_t slot)
+{
+  while(true) {
+    uint8_t first = slot;
+    uint8_t left = 2 * slot + 1;
+    uint8_t right = left + 1;
+    if(left < _count && earlier(left, first)) {
+      first = left;
+    }
+    if(right < _count && earlier(right, first)) {
+      first = right;
+    }
+    if(first == slot) {
+      break;
+    }
+    Timer *timer = _heap[first];
+    place(first, _heap[slot]);
+    place(slot, timer);
+    slot = first;
+  }
+}
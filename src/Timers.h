@@ -0,0 +1,92 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef Timers_h
+#define Timers_h
+
+#include <Arduino.h>
+#include "Board.h"
+
+#define TIMERS_MAX Board::TIMERS_MAX // Timers that can be running at once: up to three per channel, and a few for the rest.
+
+// A deadline held by Timers, and what to do when it comes. A periodic
+// timer comes round again every period; one with no callback only wakes
+// the loop.
+class Timer
+{
+  public:
+    typedef void (*Callback)(void *context);
+
+    Timer(Callback callback = NULL, void *context = NULL);
+    ~Timer();
+    bool running();
+    uint32_t deadline();
+
+  private:
+    friend class Timers;
+
+    Callback _callback;
+    void *_context;
+    uint32_t _at;
+    uint32_t _period;
+    uint8_t _slot;
+};
+
+// Every deadline in the firmware, in one min-heap.
+//
+// tick() samples millis() once at the top of loop(), and the rest of
+// the pass works from that sample through now(), so every component
+// sees the same time. run() then calls back each timer that has come
+// due, and nextDeadline() is how long the loop can sleep for.
+//
+// Times are only ever compared by their signed difference, so the
+// millis() wrap every 49 days goes unnoticed as long as no deadline is
+// more than 24 days away. They are uint32_t, as millis() is, rather
+// than unsigned long, which is 64 bits wide on the host and would carry
+// past the wrap instead of going round with it.
+class Timers
+{
+  public:
+    Timers();
+    uint32_t tick();
+    uint32_t now();
+    bool start(Timer &timer, uint32_t delay, uint32_t period = 0);
+    bool startAt(Timer &timer, uint32_t at);
+    void stop(Timer &timer);
+    uint8_t run();
+    bool nextDeadline(uint32_t &at);
+    uint8_t count();
+    unsigned long overflows();
+
+    static bool reached(uint32_t deadline, uint32_t now);
+
+  private:
+    bool earlier(uint8_t a, uint8_t b);
+    void place(uint8_t slot, Timer *timer);
+    void up(uint8_t slot);
+    void down(uint8_t slot);
+
+    Timer *_heap[TIMERS_MAX];
+    uint8_t _count;
+    uint32_t _now;
+    unsigned long _overflows;
+};
+
+extern FIRMWARE_LOCAL Timers timers;
+
+#endif
@@ -0,0 +1,183 @@
+/*--------------------------------------------------------------------
+   This file is part of the AutoVac Project.
+
+   AutoVac is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation, either version 3 of
+   the License, or (at your option) any later version.
+
+   AutoVac is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with AutoVac.  If not, see
+   <http://www.gnu.org/licenses/>.
+   --------------------------------------------------------------------*/
+
+#ifndef WindowStats_h
+#define WindowStats_h
+
+#include <math.h>
+#include <stdint.h>
+#include "RunningAverage.h"
+
+// The second moment of the window, kept as samples come and go. Integer
+// samples keep an exact sum of squares beside RunningAverage's exact
+// sum, so nothing can cancel or drift; float samples use Welford's
+// update, extended to take the oldest sample out as a new one goes in.
+template <typename T, bool INTEGRAL>
+struct WindowMoments
+{
+    float mean;
+    float m2;
+
+    void clear() { mean = 0; m2 = 0; }
+
+    void add(T value, T old, uint16_t count, bool full)
+    {
+        float previous = mean;
+        if (full) {
+            mean += (value - old) / count;
+            m2 += (value - old) * (value - mean + old - previous);
+        } else {
+            mean += (value - previous) / count;
+            m2 += (value - previous) * (value - mean);
+        }
+        if (m2 < 0) m2 = 0;
+    }
+
+    template <typename S>
+    float variance(S, uint16_t count) const { return count ? m2 / count : 0; }
+};
+
+template <typename T>
+struct WindowMoments<T, true>
+{
+    int64_t squares;
+
+    void clear() { squares = 0; }
+
+    void add(T value, T old, uint16_t, bool full)
+    {
+        int64_t x = RunningAverageTraits<T>::toSum(value);
+        squares += x * x;
+        if (full) {
+            int64_t y = RunningAverageTraits<T>::toSum(old);
+            squares -= y * y;
+        }
+    }
+
+    template <typename S>
+    float variance(S sum, uint16_t count) const
+    {
+        if (count == 0) return 0;
+        return (float)(squares * count - (int64_t)sum * sum) / ((float)count * count);
+    }
+};
+
+// RunningAverage with the variance, minimum and maximum of the same
+// window, each kept up to date in amortised O(1) per sample rather than
+// found by scanning the window.
+//
+// The extremes come from two monotonic queues of window positions: the
+// minimum's holds the positions of ever larger samples, oldest first,
+// and its front is the minimum; a new sample clears out every sample at
+// the back it is smaller than, since none of those can be the minimum
+// again while it is in the window. The maximum's is the same the other
+// way up. Each queue is a byte per window position.
+//
+// The variance is the population variance of the window; for Fixed
+// samples it is in squared raw units.
+template <typename T, uint16_t N>
+class WindowStats : public RunningAverage<T, N>
+{
+public:
+    WindowStats() { clear(); }
+
+    void clear()
+    {
+        Base::clear();
+        _moments.clear();
+        _lowest.clear();
+        _highest.clear();
+    }
+
+    void addValue(T value)
+    {
+        uint8_t slot = this->_idx;
+        bool full = this->_cnt == N;
+        T old = this->_ar[slot];
+        if (full) {
+            _lowest.expire(slot);
+            _highest.expire(slot);
+        }
+        Base::addValue(value);
+        _moments.add(value, old, this->_cnt, full);
+        _lowest.push(slot, this->_ar, Lower());
+        _highest.push(slot, this->_ar, Higher());
+    }
+
+    void fillValue(T value, uint16_t number)
+    {
+        clear();
+        for (uint16_t i = 0; i < number; i++) addValue(value);
+    }
+
+    T getMinimum() const { return this->_cnt ? this->_ar[_lowest.front()] : Traits::empty(); }
+    T getMaximum() const { return this->_cnt ? this->_ar[_highest.front()] : Traits::empty(); }
+    float getVariance() const { return _moments.variance(this->_sum, this->_cnt); }
+    float getDeviation() const { return sqrt(getVariance()); }
+
+private:
+    typedef RunningAverage<T, N> Base;
+    typedef RunningAverageTraits<T> Traits;
+    static_assert(N < 256, "Window positions are kept in bytes");
+
+    struct Lower { bool operator()(T a, T b) const { return a <= b; } };
+    struct Higher { bool operator()(T a, T b) const { return a >= b; } };
+
+    // Window positions, oldest first, in a ring of their own.
+    class Queue
+    {
+    public:
+        void clear() { _head = 0; _size = 0; }
+        uint8_t front() const { return _slots[_head]; }
+
+        // Drops the oldest sample if it is the one about to be replaced.
+        void expire(uint8_t slot)
+        {
+            if (_size > 0 && _slots[_head] == slot) {
+                _head = _head + 1 == N ? 0 : _head + 1;
+                _size--;
+            }
+        }
+
+        template <typename Keeps>
+        void push(uint8_t slot, const T *values, Keeps keeps)
+        {
+            while (_size > 0 && keeps(values[slot], values[back()])) _size--;
+            uint16_t end = _head + _size;
+            _slots[end >= N ? end - N : end] = slot;
+            _size++;
+        }
+
+    private:
+        uint8_t back() const
+        {
+            uint16_t last = _head + _size - 1;
+            return _slots[last >= N ? last - N : last];
+        }
+
+        uint8_t _slots[N];
+        uint8_t _head;
+        uint8_t _size;
+    };
+
+    WindowMoments<T, Traits::integral> _moments;
+    Queue _lowest;
+    Queue _highest;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+#
+# This file is part of the AutoVac Project, and is released under the
+# GNU Lesser General Public License; see src/COPYING.
+#
+# Generates the firmware's state transition table from the Graphviz
+# description of the state machine:
+#
+#   python tools/fsmgen.py doc/fsm.dot src/StateTable.h
+#
+# States are the nodes, in declaration order. Each edge label is
+# "event [guard]", and becomes one Transition row. Events and guards are
+# numbered in order of first appearance.
+
+import re
+import sys
+
+NODE = re.compile(r'^\s*(\w+)\s*;')
+EDGE = re.compile(r'^\s*(\w+)(?::\w+)?\s*->\s*(\w+)(?::\w+)?\s*\[\s*label\s*=\s*"([^"]*)"')
+LABEL = re.compile(r'^\s*(\w+)\s*(?:\[\s*(\w+)\s*\])?\s*$')
+
+
+def parse(path):
+    states, events, guards, edges = [], [], [], []
+    for number, line in enumerate(open(path), 1):
+        line = line.split('//')[0]
+        node = NODE.match(line)
+        if node:
+            states.append(node.group(1))
+            continue
+        edge = EDGE.match(line)
+        if not edge:
+            continue
+        source, target, label = edge.groups()
+        parts = LABEL.match(label)
+        if not parts:
+            sys.exit('%s:%d: bad label "%s"' % (path, number, label))
+        event, guard = parts.group(1), parts.group(2) or 'none'
+        for state in (source, target):
+            if state not in states:
+                sys.exit('%s:%d: undeclared state "%s"' % (path, number, state))
+        if event not in events:
+            events.append(event)
+        if guard != 'none' and guard not in guards:
+            guards.append(guard)
+        edges.append((source, event, guard, target))
+    # Stable sort keeps the dot file's order within a state, which is the
+    # order guards are tried in.
+    edges.sort(key=lambda e: states.index(e[0]))
+    return states, events, ['none'] + guards, edges
+
+
+def enum(name, prefix, items, extra):
+    lines = ['typedef enum {']
+    for i, item in enumerate(items):
+        value = ' = 0' if i == 0 else ''
+        lines.append('\t%s_%s%s,' % (prefix, item.upper(), value))
+    lines.append('\t%s_%s' % (prefix, extra))
+    lines.append('} %s;' % name)
+    return '\n'.join(lines)
+
+
+def generate(source, states, events, guards, edges):
+    out = []
+    out.append('// Generated by tools/fsmgen.py from %s. Do not edit; change the' % source)
+    out.append('// diagram and regenerate instead.')
+    out.append('')
+    out.append('#ifndef StateTable_h')
+    out.append('#define StateTable_h')
+    out.append('')
+    out.append('#include <stdint.h>')
+    out.append('#include <avr/pgmspace.h>')
+    out.append('')
+    out.append(enum('State_type', 'STATE', states, 'COUNT'))
+    out.append('')
+    out.append(enum('Event_type', 'EVENT', events, 'COUNT'))
+    out.append('')
+    out.append(enum('Guard_type', 'GUARD', guards, 'COUNT'))
+    out.append('')
+    out.append('struct Transition {')
+    out.append('\tuint8_t state;')
+    out.append('\tuint8_t event;')
+    out.append('\tuint8_t guard;')
+    out.append('\tuint8_t next;')
+    out.append('};')
+    out.append('')
+    out.append('// Rows are grouped by state; within a state, rows for the same event')
+    out.append('// are tried in order until one\'s guard passes.')
+    out.append('constexpr Transition STATE_TRANSITIONS[] PROGMEM = {')
+    for source, event, guard, target in edges:
+        out.append('\t{ STATE_%s, EVENT_%s, GUARD_%s, STATE_%s },' %
+                   (source.upper(), event.upper(), guard.upper(), target.upper()))
+    out.append('};')
+    out.append('')
+    out.append('const uint8_t STATE_TRANSITION_COUNT = sizeof(STATE_TRANSITIONS) / sizeof(STATE_TRANSITIONS[0]);')
+    out.append('')
+    out.append('constexpr uint8_t stateFirstRow(uint8_t state, uint8_t row = 0)')
+    out.append('{')
+    out.append('\treturn row >= STATE_TRANSITION_COUNT || STATE_TRANSITIONS[row].state >= state ? row : stateFirstRow(state, row + 1);')
+    out.append('}')
+    out.append('')
+    out.append('constexpr bool stateRowsGrouped(uint8_t row = 1)')
+    out.append('{')
+    out.append('\treturn row >= STATE_TRANSITION_COUNT || (STATE_TRANSITIONS[row - 1].state <= STATE_TRANSITIONS[row].state && stateRowsGrouped(row + 1));')
+    out.append('}')
+    out.append('')
+    out.append('static_assert(stateRowsGrouped(), "STATE_TRANSITIONS must be grouped by state");')
+    out.append('')
+    out.append('// STATE_TRANSITIONS rows for state s are [STATE_FIRST_ROW[s], STATE_FIRST_ROW[s + 1]).')
+    out.append('constexpr uint8_t STATE_FIRST_ROW[] PROGMEM = {')
+    for state in states + ['count']:
+        out.append('\tstateFirstRow(STATE_%s),' % state.upper())
+    out.append('};')
+    out.append('')
+    out.append('#endif')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s fsm.dot StateTable.h' % sys.argv[0])
+    states, events, guards, edges = parse(sys.argv[1])
+    with open(sys.argv[2], 'w') as f:
+        f.write(generate(sys.argv[1], states, events, guards, edges))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+#
+# This file is part of the AutoVac Project, and is released under the
+# GNU Lesser General Public License; see src/COPYING.
+#
+# Reports how much flash and SRAM a firmware build uses, and how that
+# has changed. As a PlatformIO extra script it runs after every link,
+# and compares against the previous build of the same environment:
+#
+#   extra_scripts = post:tools/sizereport.py
+#
+# It can also compare two builds directly, say from before and after a
+# change:
+#
+#   python tools/sizereport.py [--size avr-size] before.elf after.elf
+#
+# Flash is .text plus .data (the initial values are stored in flash);
+# SRAM is .data, .bss and .noinit, before any stack or heap.
+
+import os
+import re
+import subprocess
+import sys
+
+SECTION = re.compile(r'^(\.\w+)\s+(\d+)\s+\d+\s*$')
+
+
+def measure(size_tool, elf):
+    output = subprocess.check_output([size_tool, '-A', elf]).decode()
+    sections = {}
+    for line in output.splitlines():
+        match = SECTION.match(line)
+        if match:
+            sections[match.group(1)] = int(match.group(2))
+    flash = sections.get('.text', 0) + sections.get('.data', 0)
+    sram = sections.get('.data', 0) + sections.get('.bss', 0) + sections.get('.noinit', 0)
+    return flash, sram
+
+
+def line(label, now, before, limit):
+    text = '%-6s %6d bytes' % (label, now)
+    if limit:
+        text += ' (%.1f%% of %d)' % (100.0 * now / limit, limit)
+    if before is not None:
+        text += ', %+d' % (now - before)
+    return text
+
+
+def report(now, before=None, limits=(None, None)):
+    before = before or (None, None)
+    print(line('Flash', now[0], before[0], limits[0]))
+    print(line('SRAM', now[1], before[1], limits[1]))
+
+
+def load(path):
+    try:
+        with open(path) as f:
+            flash, sram = f.read().split()
+            return int(flash), int(sram)
+    except (IOError, ValueError):
+        return None
+
+
+def after_link(source, target, env):
+    elf = str(target[0])
+    board = env.BoardConfig()
+    limits = (int(board.get('upload.maximum_size', 0)) or None,
+              int(board.get('upload.maximum_ram_size', 0)) or None)
+    now = measure(env.subst('$SIZETOOL') or 'avr-size', elf)
+    saved = os.path.join(env.subst('$BUILD_DIR'), 'size.txt')
+    report(now, load(saved), limits)
+    with open(saved, 'w') as f:
+        f.write('%d %d\n' % now)
+
+
+def main():
+    args = sys.argv[1:]
+    size_tool = 'avr-size'
+    if len(args) > 1 and args[0] == '--size':
+        size_tool, args = args[1], args[2:]
+    if len(args) not in (1, 2):
+        sys.exit('usage: %s [--size avr-size] [before.elf] after.elf' % sys.argv[0])
+    before = measure(size_tool, args[0]) if len(args) == 2 else None
+    report(measure(size_tool, args[-1]), before)
+
+
+if __name__ == '__main__':
+    main()
+else:
+    Import('env')
+    env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', after_link)